@@ -0,0 +1,76 @@
+/*
+ * Packed asset archive shared by the game and tools/packc.
+ *
+ * A pack is an AssetPackHeader, an index of entryCount AssetPackEntry rows
+ * sorted by path (strcmp order), then the file contents. Every file starts
+ * on an ASSET_PACK_ALIGNMENT boundary and all offsets are from the start of
+ * the pack, so the game maps the file once and hands out pointers into it.
+ * Paths are stored relative to the repository root ("images/gun.bmp"),
+ * exactly as the game asks for them. Values are little-endian; endianTag
+ * guards against foreign files.
+ */
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ASSET_PACK_MAGIC "BPAK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ENDIAN_TAG 0x01020304u
+#define ASSET_PACK_ALIGNMENT 32
+#define ASSET_PACK_PATH_MAX 128
+
+typedef struct {
+    char path[ASSET_PACK_PATH_MAX];    // NUL-terminated
+    uint32_t offset;
+    uint32_t size;
+} AssetPackEntry;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t fileSize;
+    uint32_t entryCount;
+    uint32_t indexOffset;   // AssetPackEntry index[entryCount]
+} AssetPackHeader;
+
+static inline uint32_t assetPackAlign(uint32_t offset) {
+    return (offset + (ASSET_PACK_ALIGNMENT - 1)) & ~(uint32_t)(ASSET_PACK_ALIGNMENT - 1);
+}
+
+// Check a whole pack image: header, sorted index and every entry in bounds. Returns 0 if valid.
+static inline int assetPackValidate(const void* image, size_t size) {
+    const AssetPackHeader* header = (const AssetPackHeader*)image;
+    if (size < sizeof(AssetPackHeader) || memcmp(header->magic, ASSET_PACK_MAGIC, 4) != 0 ||
+        header->version != ASSET_PACK_VERSION || header->endianTag != ASSET_PACK_ENDIAN_TAG ||
+        header->fileSize != size || header->indexOffset % sizeof(uint32_t) != 0) return -1;
+    uint64_t indexBytes = (uint64_t)header->entryCount * sizeof(AssetPackEntry);
+    if (header->indexOffset + indexBytes > size) return -1;
+    const AssetPackEntry* index = (const AssetPackEntry*)((const unsigned char*)image + header->indexOffset);
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        if (memchr(index[i].path, '\0', ASSET_PACK_PATH_MAX) == NULL) return -1;
+        if ((uint64_t)index[i].offset + index[i].size > size) return -1;
+        if (i > 0 && strcmp(index[i - 1].path, index[i].path) >= 0) return -1;
+    }
+    return 0;
+}
+
+// Binary search a validated pack for path; NULL if it isn't packed
+static inline const AssetPackEntry* assetPackFind(const void* image, const char* path) {
+    const AssetPackHeader* header = (const AssetPackHeader*)image;
+    const AssetPackEntry* index = (const AssetPackEntry*)((const unsigned char*)image + header->indexOffset);
+    uint32_t lo = 0, hi = header->entryCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int order = strcmp(index[mid].path, path);
+        if (order == 0) return &index[mid];
+        if (order < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+#endif
@@ -5,18 +5,57 @@
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#ifdef __APPLE__
+#define STAT_MTIME_NSEC(info) ((info).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(info) ((info).st_mtim.tv_nsec)
+#endif
+#endif
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define HAVE_SSE2 1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2_TARGET 1   // AVX2 kernels built with a target attribute, picked at runtime
+#endif
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#define HAVE_INOTIFY 1
+#endif
+
+#include "level_format.h"
+#include "asset_pack.h"
 
 
 /* Layout and physics constants */
-#define MAX_PLATFORMS 12
 #define PLATFORM_WIDTH 100
 #define PLATFORM_HEIGHT 20
 #define GRAVITY 1
 #define JUMP_FORCE -15
+#define TERMINAL_VELOCITY 20      // Fastest fall, pixels per tick at SIM_BASE_HZ
 #define WINDOW_HEIGHT 600
-#define MAX_PIWO 10
 #define SPRINT_SPEED 2.0
 #define BASE_SPEED 5
+#define PLAYER_DEFAULT_WIDTH 50   // Size of batarong.bmp, used when no texture is loaded (headless)
+#define PLAYER_DEFAULT_HEIGHT 41
+
+/* Simulation timing. Physics constants are expressed per tick at
+ * SIM_BASE_HZ and rescaled for the configured SIM_TICK_HZ. */
+#define SIM_BASE_HZ 30
+#ifndef SIM_TICK_HZ
+#define SIM_TICK_HZ 60
+#endif
+#define SIM_TICK_SCALE ((float)SIM_BASE_HZ / SIM_TICK_HZ)
+#define SIM_MAX_FRAME_SECONDS 0.25 // Clamp long stalls so the sim doesn't spiral
 
 /* Sprint mechanics */
 #define MAX_SPRINT_ENERGY 100.0f
@@ -39,38 +78,284 @@
 #define SMALL_FONT_SIZE 18
 #define REGULAR_FONT_SIZE 24
 
-#define MAX_RAY 3
 #define RAY_WIDTH 64
 #define RAY_HEIGHT 64
 #define SHOP_ITEM_COUNT 3
 #define SHOP_ITEM_NAME_MAX 64
 
+/* Entity store */
+#define ENTITY_STORE_MIN_CAPACITY 64    // First allocation; columns double from there
+
 /* Bullets */
-#define MAX_BULLETS 10
 #define BULLET_SPEED 10
 #define BULLET_WIDTH 8
 #define BULLET_HEIGHT 4
+#define BULLET_CULL_MARGIN 100  // Bullets this far outside the simulated view are dropped
 
 /* Dialog system limits */
 #define DIALOG_MAX_LINES 16
 #define DIALOG_LINE_MAX 160
 
-/* Character config limits */
-#define MAX_CHARACTER_DEF 16
+/* Collision broadphase */
+#define GRID_CELL_SIZE 128
+#define PIWO_SIZE 32
+#define OVERLAP_BATCH 256       // Entities per overlapMask() call; keeps the hit mask on the stack
+#define TRIGGER_RANGE 50        // Centre distance (per axis) at which Ray and machines react to A
+
+/* Levels */
+#define DEFAULT_LEVEL_PATH "levels/bliss.lvl"
+
+/* World streaming */
+#define STREAM_VIEW_WIDTH 800                   // World pixels around the camera that must be resident
+#define STREAM_KEEP_CHUNKS 1                    // Chunks kept either side of the view before unloading
+#define STREAM_MAX_RESIDENT_CHUNKS 32
+#define STREAM_ENTITY_MAX_WIDTH PLATFORM_WIDTH  // Widest entity; chunks are keyed by left edge
+
+/* Static layer cache */
+#define STATIC_TILE_WIDTH STREAM_VIEW_WIDTH     // World pixels per cached tile: one screen width
+#define STATIC_TILE_SLOTS 4                     // Tiles kept baked: the two on screen plus one either side
+
+/* Frame profiler (built with -DPROFILER: make PROFILE=1 or make debug) */
+#define PROFILE_HISTORY 3600            // Frames kept for the CSV (a minute at 60 fps)
+#define PROFILE_WINDOW 240              // Most recent frames behind the overlay's averages, p99 and graph
+#define PROFILE_OVERLAY_REFRESH 15      // Frames between overlay text updates, so it stays readable
+#define PROFILE_CSV_PATH "profile.csv"
+
+/* Event tracing (built with -DTRACING: make TRACE=1) */
+#define TRACE_RING_EVENTS 16384         // Per thread; older events are overwritten
+#define TRACE_MAX_THREADS 16
+#define TRACE_ARG_MAX 64
+#define TRACE_JSON_PATH "trace.json"
+
+/* Headless runs and benchmark */
+#define HEADLESS_DEFAULT_TICKS 600000
+#define BENCH_DEFAULT_TICKS 1000000
+
+/* Input recording and replay (--record / --replay) */
+#define REPLAY_MAGIC "BREC"
+#define REPLAY_VERSION 3
+#define REPLAY_HASH_INTERVAL 60         // Ticks between world-state hashes in a recording
+#define SIM_DEFAULT_SEED 0x5EEDu        // RNG seed for headless runs that aren't replaying
+#define INPUT_KEY_MAX 8                 // Bet keys typed in one tick; extras wait for the next
+
+/* Save states (F5 saves, F9 loads) */
+#define SAVE_STATE_PATH "savestate.bin"
+#define SAVE_STATE_MAGIC "BSAV"
+#define SAVE_STATE_VERSION 4
+#define SAVE_SECTION_ALIGNMENT 16
+#define SAVE_BENCH_PATH "bench-savestate.bin"     // Scratch file for make bench
+
+/* Rewind (hold Z) */
+#define REWIND_SECONDS 10
+#define REWIND_MAX_TICKS (REWIND_SECONDS * SIM_TICK_HZ)
+#define REWIND_BUFFER_BYTES (256 * 1024)        // Encoded deltas; the oldest drop off to fit
+#define REWIND_BENCH_SWARM 300                  // Bullets kept alive in the rewind benchmark's last row
+
+/* Text rendering (glyph atlas + layout cache) */
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
+#define GLYPH_ATLAS_WIDTH 512
+#define MAX_GLYPH_ATLASES 4
+#define TEXT_CACHE_SIZE 64
+#define TEXT_CACHE_TEXT_MAX 256
+#define TEXT_MAX_QUADS 128
+
+/* Render batching */
+#define BATCH_MAX_QUADS 1024    // Quads per SDL_RenderGeometry / SDL_RenderFillRects call
+#define BATCH_MAX_STATES 16     // Distinct texture/blend states per flush
+
+/* Config registry */
+#define CONFIG_DIR "config"
+#define CONFIG_PATH CONFIG_DIR "/config.md"
+#define CONFIG_LINE_MAX 1024        // Longer lines are truncated
+#define CONFIG_ARENA_BLOCK 4096     // Bytes per interned-string block
+#define CONFIG_TABLE_MIN 64         // Initial hash table slots (power of two)
 #define CHARACTER_NAME_MAX 32
 #define CHARACTER_IMAGE_MAX 128
+#define MAX_CACHED_TEXTURES 32
+
+/* Sprite atlas */
+#define SPRITE_ATLAS_SIZE 1024      // Page width/height, clamped to the renderer's limit
+#define SPRITE_ATLAS_PADDING 1      // Gap between packed sprites so filtering never bleeds
+#define MAX_ATLAS_PAGES 4
+#define SPRITE_ATLAS_EXCLUDE "backgrounds" // Config category drawn full screen, kept out of the atlas
+
+/* Asset loading */
+#define ASSET_LOADER_THREADS 4      // Upper bound on decode workers (also capped by CPU count)
+#define ASSET_PACK_PATH "assets.pak" // Built by make from images/, COMIC.TTF and config/config.md
+#define PIXEL_CACHE_DIR "cache"      // Pre-converted pixels, rebuilt automatically when sources change
+#define PIXEL_CACHE_MAGIC "BPIX"
+#define PIXEL_CACHE_VERSION 2
+#define PIXEL_CACHE_SETTLE_SECONDS 1  // Sources modified more recently than this are always hashed
+
+/* Hot reload */
+#define IMAGES_DIR "images"
+#define HOT_RELOAD_QUEUE 32         // Changed images in flight between the watcher and the render thread
+#define HOT_RELOAD_POLL_MS 100      // Watcher wake-up interval (also how often it checks for shutdown)
+#define HOT_RELOAD_SETTLE_MS 50     // Wait after a change so editors finish writing before we read
+
+/*
+ * Event tracing. TRACE_BEGIN/TRACE_END (or TRACE(name, statement)) record
+ * begin/end events into a ring owned by the calling thread, so recording never
+ * takes a lock: a thread registers its ring on first use with one atomic add
+ * and is the only writer. At exit writeTraceJson() writes every ring as Chrome
+ * trace-event JSON, which chrome://tracing or Perfetto open directly. Names
+ * must be string literals (or otherwise live to exit); args are copied.
+ * Without -DTRACING the macros expand to nothing.
+ */
+#ifdef TRACING
+typedef struct {
+    Uint64 counter;
+    const char* name;
+    char phase;                 // 'B' or 'E'
+    char arg[TRACE_ARG_MAX];    // Optional detail, e.g. the file being decoded
+} TraceEvent;
 
 typedef struct {
-    char name[CHARACTER_NAME_MAX];
-    char imagePath[CHARACTER_IMAGE_MAX];
-} CharacterDefinition;
+    SDL_threadID thread;
+    char name[32];
+    SDL_atomic_t head;          // Events recorded; the ring holds the last TRACE_RING_EVENTS
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceBuffer;
+
+static TraceBuffer* traceBuffers[TRACE_MAX_THREADS];
+static SDL_atomic_t traceBufferCount;
+static _Thread_local TraceBuffer* traceLocal = NULL;
+static _Thread_local bool traceLocalFailed = false;
+static Uint64 traceStartCounter = 0;
+
+static TraceBuffer* traceBuffer(void) {
+    if (traceLocal || traceLocalFailed) return traceLocal;
+    int slot = SDL_AtomicAdd(&traceBufferCount, 1);
+    TraceBuffer* buffer = slot < TRACE_MAX_THREADS ? calloc(1, sizeof(TraceBuffer)) : NULL;
+    if (!buffer) {
+        traceLocalFailed = true;
+        return NULL;
+    }
+    buffer->thread = SDL_ThreadID();
+    snprintf(buffer->name, sizeof(buffer->name), "thread %d", slot);
+    SDL_AtomicSetPtr((void**)&traceBuffers[slot], buffer);
+    traceLocal = buffer;
+    return buffer;
+}
+
+static void traceEvent(char phase, const char* name, const char* arg) {
+    TraceBuffer* buffer = traceBuffer();
+    if (!buffer) return;
+    int head = SDL_AtomicGet(&buffer->head);
+    TraceEvent* event = &buffer->events[head % TRACE_RING_EVENTS];
+    event->counter = SDL_GetPerformanceCounter();
+    event->name = name;
+    event->phase = phase;
+    snprintf(event->arg, sizeof(event->arg), "%s", arg ? arg : "");
+    SDL_AtomicSet(&buffer->head, head + 1); // Publishes the event
+}
+
+// Label the calling thread in the trace
+static void traceThreadName(const char* name) {
+    TraceBuffer* buffer = traceBuffer();
+    if (buffer) snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+}
+
+static void traceStart(void) {
+    traceStartCounter = SDL_GetPerformanceCounter();
+    traceThreadName("main");
+}
+
+static void writeTraceString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if (*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// Call once every traced thread has stopped
+static void writeTraceJson(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Error writing trace: %s\n", path);
+        return;
+    }
+    const double usPerCount = 1e6 / (double)SDL_GetPerformanceFrequency();
+    int bufferCount = SDL_AtomicGet(&traceBufferCount);
+    if (bufferCount > TRACE_MAX_THREADS) bufferCount = TRACE_MAX_THREADS;
+    long written = 0;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int b = 0; b < bufferCount; b++) {
+        TraceBuffer* buffer = SDL_AtomicGetPtr((void**)&traceBuffers[b]);
+        if (!buffer) continue;
+        unsigned long tid = (unsigned long)buffer->thread;
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":", written++ ? ",\n" : "", tid);
+        writeTraceString(file, buffer->name);
+        fprintf(file, "}}");
+        int head = SDL_AtomicGet(&buffer->head);
+        int first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+        int depth = 0;
+        for (int i = first; i < head; i++) {
+            const TraceEvent* event = &buffer->events[i % TRACE_RING_EVENTS];
+            if (event->phase == 'E' && depth == 0) continue; // Its begin was overwritten
+            depth += event->phase == 'B' ? 1 : -1;
+            fprintf(file, ",\n{\"name\":");
+            writeTraceString(file, event->name);
+            fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu", event->phase,
+                    (double)(event->counter - traceStartCounter) * usPerCount, tid);
+            if (event->arg[0]) {
+                fprintf(file, ",\"args\":{\"detail\":");
+                writeTraceString(file, event->arg);
+                fprintf(file, "}");
+            }
+            fprintf(file, "}");
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) == 0) printf("Trace of %ld events written to %s\n", written - bufferCount, path);
+    for (int b = 0; b < bufferCount; b++) {
+        free(traceBuffers[b]);
+        traceBuffers[b] = NULL;
+    }
+}
+
+#define TRACE_BEGIN(name) traceEvent('B', name, NULL)
+#define TRACE_BEGIN_ARG(name, arg) traceEvent('B', name, arg)
+#define TRACE_END(name) traceEvent('E', name, NULL)
+#define TRACE_THREAD(name) traceThreadName(name)
+#define TRACE(name, ...) do { TRACE_BEGIN(name); __VA_ARGS__; TRACE_END(name); } while (0)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_BEGIN_ARG(name, arg) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE(name, ...) do { __VA_ARGS__; } while (0)
+#endif
+
+// FNV-1a, 64-bit, continuing from a previous hash so records can be hashed field by field
+static Uint64 hashBytesFrom(Uint64 hash, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static Uint64 hashBytes(const void* data, size_t size) {
+    return hashBytesFrom(14695981039346656037ull, data, size);
+}
 
-static CharacterDefinition characterDefinitions[MAX_CHARACTER_DEF];
-static int characterDefinitionCount = 0;
+static Uint64 hashText(const char* text) {
+    return hashBytes(text, strlen(text));
+}
 
 typedef struct {
     void* data;
     size_t size;
+    bool mapped;    // data is an mmap view rather than a malloc'd copy
+    bool borrowed;  // data points into the asset pack; nothing to free
 } MemoryFile;
 
 static int loadFileToMemory(const char* filePath, MemoryFile* output) {
@@ -95,11 +380,493 @@ static int loadFileToMemory(const char* filePath, MemoryFile* output) {
     return 0;
 }
 
+// Map a file read-only into memory, falling back to a heap copy where mmap is unavailable
+static int mapFileToMemory(const char* filePath, MemoryFile* output) {
+#ifdef HAVE_MMAP
+    if (!output) return -1;
+    memset(output, 0, sizeof(*output));
+    int fd = open(filePath, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", filePath);
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) { close(fd); return -1; }
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference
+    if (view == MAP_FAILED) return loadFileToMemory(filePath, output);
+    output->data = view;
+    output->size = (size_t)info.st_size;
+    output->mapped = true;
+    return 0;
+#else
+    return loadFileToMemory(filePath, output);
+#endif
+}
+
+static void releaseMemoryFile(MemoryFile* file) {
+    if (!file || !file->data) return;
+    if (file->borrowed) {
+        memset(file, 0, sizeof(*file));
+        return;
+    }
+#ifdef HAVE_MMAP
+    if (file->mapped) munmap(file->data, file->size);
+    else
+#endif
+    free(file->data);
+    memset(file, 0, sizeof(*file));
+}
+
+/*
+ * Asset pack. openAssetPack() maps ASSET_PACK_PATH once; loadAsset() then
+ * hands out borrowed views straight into the mapping, so opening an image,
+ * the font or the config costs a binary search and no I/O or copies. Paths
+ * missing from the pack (or every path, when there is no pack) fall back to
+ * reading the loose file, which keeps unpacked development trees working.
+ * The pack is read-only after opening, so worker threads may call loadAsset().
+ */
+static MemoryFile assetPack = {0};
+static bool looseFilesFirst = false;    // Set once hot reload starts so edited files beat the pack
+
+static void openAssetPack(const char* path) {
+    MemoryFile file;
+    if (mapFileToMemory(path, &file) != 0) {
+        printf("Asset pack %s not found, reading loose files\n", path);
+        return;
+    }
+    if (assetPackValidate(file.data, file.size) != 0) {
+        printf("Invalid asset pack %s, reading loose files\n", path);
+        releaseMemoryFile(&file);
+        return;
+    }
+    assetPack = file;
+}
+
+static void closeAssetPack(void) {
+    releaseMemoryFile(&assetPack);
+}
+
+// Borrowed view from the pack, or a heap copy of the loose file; release with releaseMemoryFile()
+static int loadAsset(const char* path, MemoryFile* output) {
+    const AssetPackEntry* entry = assetPack.data ? assetPackFind(assetPack.data, path) : NULL;
+    if (entry && looseFilesFirst) {
+        FILE* loose = fopen(path, "rb");
+        if (loose) {
+            fclose(loose);
+            entry = NULL;
+        }
+    }
+    if (!entry) return loadFileToMemory(path, output);
+    output->data = (unsigned char*)assetPack.data + entry->offset;
+    output->size = entry->size;
+    output->mapped = false;
+    output->borrowed = true;
+    return 0;
+}
+
 // Keep font buffer alive for lifetime of program (TTF might stream)
 static MemoryFile mainFontMem = {0};
 
+/*
+ * Text rendering.
+ * Each font gets a glyph atlas: printable ASCII is rasterized once into a
+ * single texture and strings are drawn as textured quads in one
+ * SDL_RenderGeometry call. Laid-out strings are kept in a small
+ * direct-mapped cache so unchanged HUD text skips layout entirely.
+ */
+typedef struct {
+    SDL_Rect src;   // Sub-rect of the glyph in the atlas (w == 0 for blank glyphs)
+    int advance;    // Horizontal pen advance in pixels
+} Glyph;
+
+typedef struct {
+    TTF_Font* font;
+    SDL_Texture* texture;
+    int atlasWidth, atlasHeight;
+    int lineHeight;
+    Glyph glyphs[GLYPH_COUNT];
+} GlyphAtlas;
+
+typedef struct {
+    const GlyphAtlas* atlas;
+    Uint32 hash;
+    char text[TEXT_CACHE_TEXT_MAX];
+    int quadCount;
+    int width;
+    SDL_Vertex* vertices;   // 4 per quad, positioned relative to the string origin
+    int vertexCapacity;
+} TextCacheEntry;
+
+static GlyphAtlas glyphAtlases[MAX_GLYPH_ATLASES];
+static int glyphAtlasCount = 0;
+static TextCacheEntry textCache[TEXT_CACHE_SIZE];
+static SDL_Vertex textScratch[TEXT_MAX_QUADS * 4];
+static int textIndices[TEXT_MAX_QUADS * 6];
+
+static const GlyphAtlas* findGlyphAtlas(TTF_Font* font) {
+    for (int i = 0; i < glyphAtlasCount; i++) {
+        if (glyphAtlases[i].font == font) return &glyphAtlases[i];
+    }
+    return NULL;
+}
+
+// Rasterize printable ASCII of a font into one texture (shelf packed)
+static bool buildGlyphAtlas(SDL_Renderer* renderer, TTF_Font* font) {
+    if (!renderer || !font || glyphAtlasCount >= MAX_GLYPH_ATLASES) return false;
+    if (findGlyphAtlas(font)) return true;
+    GlyphAtlas* atlas = &glyphAtlases[glyphAtlasCount];
+    memset(atlas, 0, sizeof(*atlas));
+    atlas->font = font;
+    atlas->lineHeight = TTF_FontHeight(font);
+
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface* glyphSurfaces[GLYPH_COUNT] = {0};
+    int penX = 0, penY = 0, rowHeight = 0;
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        char ch[2] = { (char)(GLYPH_FIRST + i), '\0' };
+        int minX, maxX, minY, maxY, advance = 0;
+        if (TTF_GlyphMetrics(font, (Uint16)ch[0], &minX, &maxX, &minY, &maxY, &advance) != 0) advance = 0;
+        atlas->glyphs[i].advance = advance;
+        glyphSurfaces[i] = (ch[0] == ' ') ? NULL : TTF_RenderText_Solid(font, ch, white);
+        if (!glyphSurfaces[i]) continue;
+        int w = glyphSurfaces[i]->w, h = glyphSurfaces[i]->h;
+        if (penX + w + 1 > GLYPH_ATLAS_WIDTH) { penX = 0; penY += rowHeight + 1; rowHeight = 0; }
+        atlas->glyphs[i].src = (SDL_Rect){ penX, penY, w, h };
+        penX += w + 1;
+        if (h > rowHeight) rowHeight = h;
+    }
+    atlas->atlasWidth = GLYPH_ATLAS_WIDTH;
+    atlas->atlasHeight = penY + rowHeight;
+
+    bool ok = false;
+    SDL_Surface* sheet = atlas->atlasHeight > 0
+        ? SDL_CreateRGBSurfaceWithFormat(0, atlas->atlasWidth, atlas->atlasHeight, 32, SDL_PIXELFORMAT_RGBA32)
+        : NULL;
+    if (sheet) {
+        SDL_FillRect(sheet, NULL, 0); // Fully transparent; Solid glyphs are colorkeyed so only ink is copied
+        for (int i = 0; i < GLYPH_COUNT; i++) {
+            if (!glyphSurfaces[i]) continue;
+            SDL_Rect dst = atlas->glyphs[i].src;
+            SDL_BlitSurface(glyphSurfaces[i], NULL, sheet, &dst);
+        }
+        TRACE_BEGIN("uploadGlyphAtlas");
+        atlas->texture = SDL_CreateTextureFromSurface(renderer, sheet);
+        TRACE_END("uploadGlyphAtlas");
+        if (atlas->texture) {
+            SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+            ok = true;
+        } else {
+            printf("Unable to create glyph atlas texture! SDL Error: %s\n", SDL_GetError());
+        }
+        SDL_FreeSurface(sheet);
+    }
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        if (glyphSurfaces[i]) SDL_FreeSurface(glyphSurfaces[i]);
+    }
+    if (ok) glyphAtlasCount++;
+    return ok;
+}
+
+static bool initTextRenderer(SDL_Renderer* renderer, TTF_Font** fonts, int fontCount) {
+    for (int q = 0; q < TEXT_MAX_QUADS; q++) {
+        int* idx = &textIndices[q * 6];
+        int base = q * 4;
+        idx[0] = base; idx[1] = base + 1; idx[2] = base + 2;
+        idx[3] = base + 2; idx[4] = base + 3; idx[5] = base;
+    }
+    bool ok = true;
+    for (int i = 0; i < fontCount; i++) ok = buildGlyphAtlas(renderer, fonts[i]) && ok;
+    return ok;
+}
+
+static void destroyTextRenderer(void) {
+    for (int i = 0; i < TEXT_CACHE_SIZE; i++) free(textCache[i].vertices);
+    memset(textCache, 0, sizeof(textCache));
+    for (int i = 0; i < glyphAtlasCount; i++) {
+        if (glyphAtlases[i].texture) SDL_DestroyTexture(glyphAtlases[i].texture);
+    }
+    glyphAtlasCount = 0;
+}
+
+// Lay out a string against an atlas (or return the cached layout)
+static const TextCacheEntry* layoutText(const GlyphAtlas* atlas, const char* text) {
+    size_t len = strlen(text);
+    if (len >= TEXT_CACHE_TEXT_MAX) len = TEXT_CACHE_TEXT_MAX - 1;
+    Uint32 hash = (Uint32)hashText(text) ^ (Uint32)(uintptr_t)atlas;
+    TextCacheEntry* entry = &textCache[hash % TEXT_CACHE_SIZE];
+    if (entry->atlas == atlas && entry->hash == hash &&
+        strncmp(entry->text, text, len) == 0 && entry->text[len] == '\0') {
+        return entry;
+    }
+
+    if (entry->vertexCapacity < (int)len * 4) {
+        SDL_Vertex* grown = realloc(entry->vertices, len * 4 * sizeof(SDL_Vertex));
+        if (!grown) return NULL;
+        entry->vertices = grown;
+        entry->vertexCapacity = (int)len * 4;
+    }
+    entry->atlas = atlas;
+    entry->hash = hash;
+    memcpy(entry->text, text, len);
+    entry->text[len] = '\0';
+
+    const float invW = 1.0f / (float)atlas->atlasWidth;
+    const float invH = 1.0f / (float)atlas->atlasHeight;
+    int penX = 0, quads = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c < GLYPH_FIRST || c > GLYPH_LAST) c = '?';
+        const Glyph* g = &atlas->glyphs[c - GLYPH_FIRST];
+        if (g->src.w > 0) {
+            SDL_Vertex* v = &entry->vertices[quads * 4];
+            float x0 = (float)penX, y0 = 0.0f;
+            float x1 = x0 + g->src.w, y1 = y0 + g->src.h;
+            float u0 = g->src.x * invW, v0 = g->src.y * invH;
+            float u1 = (g->src.x + g->src.w) * invW, v1 = (g->src.y + g->src.h) * invH;
+            v[0] = (SDL_Vertex){ {x0, y0}, {255, 255, 255, 255}, {u0, v0} };
+            v[1] = (SDL_Vertex){ {x1, y0}, {255, 255, 255, 255}, {u1, v0} };
+            v[2] = (SDL_Vertex){ {x1, y1}, {255, 255, 255, 255}, {u1, v1} };
+            v[3] = (SDL_Vertex){ {x0, y1}, {255, 255, 255, 255}, {u0, v1} };
+            quads++;
+        }
+        penX += g->advance;
+    }
+    entry->quadCount = quads;
+    entry->width = penX;
+    return entry;
+}
+
+// Width in pixels of a string as drawn by renderText
+static int measureText(TTF_Font* font, const char* text) {
+    const GlyphAtlas* atlas = findGlyphAtlas(font);
+    if (atlas) {
+        const TextCacheEntry* layout = layoutText(atlas, text);
+        return layout ? layout->width : 0;
+    }
+    int w = 0, h = 0;
+    if (TTF_SizeText(font, text, &w, &h) != 0) return 0;
+    return w;
+}
+
+void renderText(SDL_Renderer* renderer, TTF_Font* font, const char* text, SDL_Color color, int x, int y) {
+    if (!text || !*text) return;
+    const GlyphAtlas* atlas = findGlyphAtlas(font);
+    const TextCacheEntry* layout = atlas ? layoutText(atlas, text) : NULL;
+    if (!layout) {
+        // No atlas for this font; fall back to one-off rasterization
+        TRACE_BEGIN_ARG("renderText fallback", text);
+        SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, color);
+        if (textSurface) {
+            SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
+            SDL_Rect textRect = { x, y, textSurface->w, textSurface->h };
+            SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
+            SDL_DestroyTexture(textTexture);
+            SDL_FreeSurface(textSurface);
+        }
+        TRACE_END("renderText fallback");
+        return;
+    }
+
+    for (int start = 0; start < layout->quadCount; start += TEXT_MAX_QUADS) {
+        int quads = layout->quadCount - start;
+        if (quads > TEXT_MAX_QUADS) quads = TEXT_MAX_QUADS;
+        const SDL_Vertex* src = &layout->vertices[start * 4];
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        for (int i = 0; i < quads * 4; i++) {
+            textScratch[i] = src[i];
+            textScratch[i].position.x += (float)x;
+            textScratch[i].position.y += (float)y;
+            textScratch[i].color = (SDL_Color){ color.r, color.g, color.b, 255 };
+        }
+        SDL_RenderGeometry(renderer, atlas->texture, textScratch, quads * 4, textIndices, quads * 6);
+#else
+        SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+        for (int q = 0; q < quads; q++) {
+            const SDL_Vertex* v = &src[q * 4];
+            SDL_Rect srcRect = {
+                (int)(v[0].tex_coord.x * atlas->atlasWidth + 0.5f), (int)(v[0].tex_coord.y * atlas->atlasHeight + 0.5f),
+                (int)(v[2].position.x - v[0].position.x), (int)(v[2].position.y - v[0].position.y)
+            };
+            SDL_Rect dstRect = { x + (int)v[0].position.x, y + (int)v[0].position.y, srcRect.w, srcRect.h };
+            SDL_RenderCopy(renderer, atlas->texture, &srcRect, &dstRect);
+        }
+#endif
+    }
+}
+
+/*
+ * Render batching. Draws are queued with batchFillRect()/batchTexture() and
+ * submitted by flushRenderBatch(), grouped by (texture, blend) state in the
+ * order each state first appeared: solid rects of one color go out as one
+ * SDL_RenderFillRects, mixed colors and textured quads as one
+ * SDL_RenderGeometry per state. Draw order is kept within a state but not
+ * across states, so flush before anything that has to land on top.
+ */
+typedef struct {
+    SDL_Texture* texture;   // NULL for solid rects
+    SDL_BlendMode blend;    // Draw blend mode for solid rects (textures use their own)
+    SDL_Color color;
+    SDL_Rect src;           // Texture sub-rect; w == 0 for the whole texture
+    SDL_Rect dst;
+    SDL_RendererFlip flip;
+    int state;              // Index into batchStates, assigned on flush
+} BatchCommand;
+
+static BatchCommand* batchCommands = NULL;
+static BatchCommand* batchSorted = NULL;
+static int batchCount = 0;
+static int batchCapacity = 0;
+static SDL_Vertex batchVertices[BATCH_MAX_QUADS * 4];
+static int batchIndices[BATCH_MAX_QUADS * 6];
+static SDL_Rect batchRects[BATCH_MAX_QUADS];
+
+static BatchCommand* pushBatchCommand(void) {
+    if (batchCount == batchCapacity) {
+        int capacity = batchCapacity ? batchCapacity * 2 : 256;
+        BatchCommand* commands = realloc(batchCommands, sizeof(BatchCommand) * (size_t)capacity);
+        if (!commands) return NULL;
+        batchCommands = commands;
+        BatchCommand* sorted = realloc(batchSorted, sizeof(BatchCommand) * (size_t)capacity);
+        if (!sorted) return NULL;
+        batchSorted = sorted;
+        batchCapacity = capacity;
+    }
+    return &batchCommands[batchCount++];
+}
+
+static void batchFillRect(const SDL_Rect* rect, SDL_Color color, SDL_BlendMode blend) {
+    BatchCommand* cmd = pushBatchCommand();
+    if (!cmd) return;
+    *cmd = (BatchCommand){ NULL, blend, color, {0, 0, 0, 0}, *rect, SDL_FLIP_NONE, 0 };
+}
+
+static void batchTexture(SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst, SDL_RendererFlip flip) {
+    if (!texture) return;
+    BatchCommand* cmd = pushBatchCommand();
+    if (!cmd) return;
+    *cmd = (BatchCommand){ texture, SDL_BLENDMODE_NONE, {255, 255, 255, 255}, src ? *src : (SDL_Rect){0, 0, 0, 0}, *dst, flip, 0 };
+}
+
+// Submit one state's commands: cmds all share texture and blend
+static void flushBatchState(SDL_Renderer* renderer, const BatchCommand* cmds, int count) {
+    SDL_Texture* texture = cmds[0].texture;
+    if (!texture) SDL_SetRenderDrawBlendMode(renderer, cmds[0].blend);
+    bool oneColor = true;
+    for (int i = 1; i < count && oneColor; i++) {
+        oneColor = memcmp(&cmds[i].color, &cmds[0].color, sizeof(SDL_Color)) == 0;
+    }
+    if (!texture && oneColor) {
+        SDL_SetRenderDrawColor(renderer, cmds[0].color.r, cmds[0].color.g, cmds[0].color.b, cmds[0].color.a);
+        for (int start = 0; start < count; start += BATCH_MAX_QUADS) {
+            int n = count - start < BATCH_MAX_QUADS ? count - start : BATCH_MAX_QUADS;
+            for (int i = 0; i < n; i++) batchRects[i] = cmds[start + i].dst;
+            SDL_RenderFillRects(renderer, batchRects, n);
+        }
+    } else {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        float texW = 1.0f, texH = 1.0f;
+        if (texture) {
+            int w = 0, h = 0;
+            SDL_QueryTexture(texture, NULL, NULL, &w, &h);
+            if (w > 0 && h > 0) { texW = (float)w; texH = (float)h; }
+        }
+        for (int start = 0; start < count; start += BATCH_MAX_QUADS) {
+            int n = count - start < BATCH_MAX_QUADS ? count - start : BATCH_MAX_QUADS;
+            for (int q = 0; q < n; q++) {
+                const BatchCommand* cmd = &cmds[start + q];
+                float x0 = (float)cmd->dst.x, y0 = (float)cmd->dst.y;
+                float x1 = x0 + (float)cmd->dst.w, y1 = y0 + (float)cmd->dst.h;
+                float u0 = 0.0f, v0 = 0.0f, u1 = 1.0f, v1 = 1.0f;
+                if (cmd->src.w > 0) {
+                    u0 = cmd->src.x / texW; v0 = cmd->src.y / texH;
+                    u1 = (cmd->src.x + cmd->src.w) / texW; v1 = (cmd->src.y + cmd->src.h) / texH;
+                }
+                if (cmd->flip & SDL_FLIP_HORIZONTAL) { float t = u0; u0 = u1; u1 = t; }
+                if (cmd->flip & SDL_FLIP_VERTICAL) { float t = v0; v0 = v1; v1 = t; }
+                SDL_Vertex* v = &batchVertices[q * 4];
+                v[0] = (SDL_Vertex){ { x0, y0 }, cmd->color, { u0, v0 } };
+                v[1] = (SDL_Vertex){ { x1, y0 }, cmd->color, { u1, v0 } };
+                v[2] = (SDL_Vertex){ { x1, y1 }, cmd->color, { u1, v1 } };
+                v[3] = (SDL_Vertex){ { x0, y1 }, cmd->color, { u0, v1 } };
+            }
+            SDL_RenderGeometry(renderer, texture, batchVertices, n * 4, batchIndices, n * 6);
+        }
+#else
+        for (int i = 0; i < count; i++) {
+            const BatchCommand* cmd = &cmds[i];
+            if (texture) {
+                SDL_RenderCopyEx(renderer, texture, cmd->src.w > 0 ? &cmd->src : NULL, &cmd->dst, 0, NULL, cmd->flip);
+            } else {
+                SDL_SetRenderDrawColor(renderer, cmd->color.r, cmd->color.g, cmd->color.b, cmd->color.a);
+                SDL_RenderFillRect(renderer, &cmd->dst);
+            }
+        }
+#endif
+    }
+    if (!texture) SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+}
+
+static void flushRenderBatch(SDL_Renderer* renderer) {
+    static bool indicesReady = false;
+    if (batchCount == 0) return;
+    if (!indicesReady) {
+        indicesReady = true;
+        for (int q = 0; q < BATCH_MAX_QUADS; q++) {
+            int* idx = &batchIndices[q * 6];
+            int base = q * 4;
+            idx[0] = base; idx[1] = base + 1; idx[2] = base + 2;
+            idx[3] = base + 2; idx[4] = base + 3; idx[5] = base;
+        }
+    }
+
+    // Number states in order of first use, then counting-sort commands by state (stable)
+    SDL_Texture* stateTexture[BATCH_MAX_STATES];
+    SDL_BlendMode stateBlend[BATCH_MAX_STATES];
+    int processed = 0;
+    while (processed < batchCount) {
+        int stateStart[BATCH_MAX_STATES + 1] = {0};
+        int stateCount = 0;
+        int end = processed;
+        for (; end < batchCount; end++) {
+            BatchCommand* cmd = &batchCommands[end];
+            int state = 0;
+            while (state < stateCount && (stateTexture[state] != cmd->texture ||
+                   (!cmd->texture && stateBlend[state] != cmd->blend))) state++;
+            if (state == stateCount) {
+                if (stateCount == BATCH_MAX_STATES) break; // Too many states: flush what we have first
+                stateTexture[stateCount] = cmd->texture;
+                stateBlend[stateCount] = cmd->blend;
+                stateCount++;
+            }
+            cmd->state = state;
+            stateStart[state + 1]++;
+        }
+        for (int i = 0; i < stateCount; i++) stateStart[i + 1] += stateStart[i];
+        int fill[BATCH_MAX_STATES];
+        memcpy(fill, stateStart, sizeof(int) * (size_t)stateCount);
+        for (int i = processed; i < end; i++) batchSorted[fill[batchCommands[i].state]++] = batchCommands[i];
+        for (int i = 0; i < stateCount; i++) {
+            flushBatchState(renderer, &batchSorted[stateStart[i]], stateStart[i + 1] - stateStart[i]);
+        }
+        processed = end;
+    }
+    batchCount = 0;
+}
+
+static void destroyRenderBatch(void) {
+    free(batchCommands);
+    free(batchSorted);
+    batchCommands = batchSorted = NULL;
+    batchCount = batchCapacity = 0;
+}
+
+// Bumped whenever something baked into the static layer may have changed (level data, sprites)
+static Uint32 staticLayerGeneration = 1;
+
 // Loading screen state
 static void renderLoadingScreen(SDL_Renderer* renderer, TTF_Font* font, const char* status, int step, int total) {
+    TRACE_BEGIN_ARG("renderLoadingScreen", status);
     SDL_SetRenderDrawColor(renderer, 10, 10, 30, 255);
     SDL_RenderClear(renderer);
     int barWidth = (int)((total > 0) ? (float)step / total * 600 : 0);
@@ -113,16 +880,10 @@ static void renderLoadingScreen(SDL_Renderer* renderer, TTF_Font* font, const ch
         SDL_Color white = {255, 255, 255, 255};
         char line[256];
         snprintf(line, sizeof(line), "%s (%d/%d)", status, step, total);
-        SDL_Surface* surface = TTF_RenderText_Solid(font, line, white);
-        if (surface) {
-            SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-            SDL_Rect textRect = { (800 - surface->w) / 2, 220, surface->w, surface->h };
-            SDL_RenderCopy(renderer, texture, NULL, &textRect);
-            SDL_DestroyTexture(texture);
-            SDL_FreeSurface(surface);
-        }
+        renderText(renderer, font, line, white, (800 - measureText(font, line)) / 2, 220);
     }
     SDL_RenderPresent(renderer);
+    TRACE_END("renderLoadingScreen");
 }
 
 static char* ltrim(char* s) {
@@ -135,41 +896,335 @@ static void rtrim(char* s) {
     while (len>0 && (s[len-1]=='\n'||s[len-1]=='\r'||s[len-1]==' '||s[len-1]=='\t')) { s[--len]='\0'; }
 }
 
-static void addCharacterDefinition(const char* name, const char* imagePath) {
-    if (!name || !*name || !imagePath || !*imagePath) return;
-    for (int i = 0; i < characterDefinitionCount; i++) {
-        if (strcmp(characterDefinitions[i].name, name) == 0) {
-            snprintf(characterDefinitions[i].imagePath, CHARACTER_IMAGE_MAX, "%s", imagePath);
+/*
+ * Config registry. Every "## name" section of config/config.md becomes a
+ * ConfigEntry holding typed key=value properties (image="...", size=64x64,
+ * position=100 200, price=5, scale=1.5, hidden=true). Names, categories, keys
+ * and string values are interned: stored once in an arena and compared by
+ * pointer. Entries live in a growable array indexed by an open-addressing
+ * hash table, so lookups by name are O(1) however many worlds' worth of
+ * definitions are loaded. A section listed twice merges, later values winning.
+ */
+typedef enum {
+    CONFIG_STRING,
+    CONFIG_INT,
+    CONFIG_FLOAT,
+    CONFIG_BOOL,
+    CONFIG_VEC2     // "x y", "x,y" or "WxH"
+} ConfigValueType;
+
+typedef struct {
+    const char* key;        // Interned
+    ConfigValueType type;
+    union {
+        const char* string; // Interned
+        long long integer;
+        double number;
+        bool boolean;
+        struct { double x, y; } vec2;
+    } value;
+} ConfigProperty;
+
+typedef struct {
+    const char* name;       // Interned "## name"
+    const char* category;   // Interned "# category" the entry was listed under
+    ConfigProperty* properties;
+    int propertyCount;
+    int propertyCapacity;
+} ConfigEntry;
+
+typedef struct StringBlock {
+    struct StringBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+} StringBlock;
+
+// Everything parsed from one config file; owns its interned strings
+typedef struct {
+    StringBlock* stringBlocks;
+    const char** internTable;   // Open addressing, NULL = empty
+    size_t internCapacity;
+    size_t internCount;
+    ConfigEntry* entries;
+    int entryCount;
+    int entryCapacity;
+    int* table;                 // Entry index + 1, 0 = empty
+    size_t tableCapacity;
+} ConfigRegistry;
+
+static ConfigRegistry configRegistry = {0}; // The live config; replaced wholesale on reload
+
+// Find an interned copy of text without adding one
+static const char* findInterned(const ConfigRegistry* registry, const char* text) {
+    if (!registry->internTable) return NULL;
+    size_t mask = registry->internCapacity - 1;
+    for (size_t i = (size_t)hashText(text) & mask;; i = (i + 1) & mask) {
+        if (!registry->internTable[i]) return NULL;
+        if (strcmp(registry->internTable[i], text) == 0) return registry->internTable[i];
+    }
+}
+
+static bool growInternTable(ConfigRegistry* registry) {
+    size_t capacity = registry->internCapacity ? registry->internCapacity * 2 : CONFIG_TABLE_MIN;
+    const char** table = calloc(capacity, sizeof(const char*));
+    if (!table) return false;
+    for (size_t i = 0; i < registry->internCapacity; i++) {
+        if (!registry->internTable[i]) continue;
+        size_t slot = (size_t)hashText(registry->internTable[i]) & (capacity - 1);
+        while (table[slot]) slot = (slot + 1) & (capacity - 1);
+        table[slot] = registry->internTable[i];
+    }
+    free(registry->internTable);
+    registry->internTable = table;
+    registry->internCapacity = capacity;
+    return true;
+}
+
+// Stable shared copy of text; equal strings give the same pointer. NULL if out of memory.
+static const char* internString(ConfigRegistry* registry, const char* text) {
+    const char* existing = findInterned(registry, text);
+    if (existing) return existing;
+    if ((registry->internCount + 1) * 2 > registry->internCapacity && !growInternTable(registry)) return NULL;
+    size_t length = strlen(text) + 1;
+    StringBlock* block = registry->stringBlocks;
+    if (!block || block->size - block->used < length) {
+        size_t size = length > CONFIG_ARENA_BLOCK ? length : CONFIG_ARENA_BLOCK;
+        block = malloc(sizeof(StringBlock) + size);
+        if (!block) return NULL;
+        block->next = registry->stringBlocks;
+        block->used = 0;
+        block->size = size;
+        registry->stringBlocks = block;
+    }
+    char* copy = block->data + block->used;
+    memcpy(copy, text, length);
+    block->used += length;
+    size_t mask = registry->internCapacity - 1;
+    size_t slot = (size_t)hashText(copy) & mask;
+    while (registry->internTable[slot]) slot = (slot + 1) & mask;
+    registry->internTable[slot] = copy;
+    registry->internCount++;
+    return copy;
+}
+
+static ConfigEntry* findRegistryEntry(const ConfigRegistry* registry, const char* name) {
+    const char* key = name && registry->table ? findInterned(registry, name) : NULL;
+    if (!key) return NULL;
+    size_t mask = registry->tableCapacity - 1;
+    for (size_t i = (size_t)hashText(key) & mask;; i = (i + 1) & mask) {
+        if (!registry->table[i]) return NULL;
+        if (registry->entries[registry->table[i] - 1].name == key) return &registry->entries[registry->table[i] - 1];
+    }
+}
+
+static ConfigEntry* findConfigEntry(const char* name) {
+    return findRegistryEntry(&configRegistry, name);
+}
+
+static bool growConfigTable(ConfigRegistry* registry) {
+    size_t capacity = registry->tableCapacity ? registry->tableCapacity * 2 : CONFIG_TABLE_MIN;
+    int* table = calloc(capacity, sizeof(int));
+    if (!table) return false;
+    for (int i = 0; i < registry->entryCount; i++) {
+        size_t slot = (size_t)hashText(registry->entries[i].name) & (capacity - 1);
+        while (table[slot]) slot = (slot + 1) & (capacity - 1);
+        table[slot] = i + 1;
+    }
+    free(registry->table);
+    registry->table = table;
+    registry->tableCapacity = capacity;
+    return true;
+}
+
+// Entry for name, created (under category) if it doesn't exist yet
+static ConfigEntry* addConfigEntry(ConfigRegistry* registry, const char* category, const char* name) {
+    const char* internedName = internString(registry, name);
+    const char* internedCategory = internString(registry, category);
+    if (!internedName || !internedCategory) return NULL;
+    ConfigEntry* entry = findRegistryEntry(registry, internedName);
+    if (entry) {
+        entry->category = internedCategory;
+        return entry;
+    }
+    if ((size_t)(registry->entryCount + 1) * 2 > registry->tableCapacity && !growConfigTable(registry)) return NULL;
+    if (registry->entryCount == registry->entryCapacity) {
+        int capacity = registry->entryCapacity ? registry->entryCapacity * 2 : 16;
+        ConfigEntry* entries = realloc(registry->entries, (size_t)capacity * sizeof(ConfigEntry));
+        if (!entries) return NULL;
+        registry->entries = entries;
+        registry->entryCapacity = capacity;
+    }
+    entry = &registry->entries[registry->entryCount++];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = internedName;
+    entry->category = internedCategory;
+    size_t mask = registry->tableCapacity - 1;
+    size_t slot = (size_t)hashText(internedName) & mask;
+    while (registry->table[slot]) slot = (slot + 1) & mask;
+    registry->table[slot] = registry->entryCount;
+    return entry;
+}
+
+static const ConfigProperty* findRegistryProperty(const ConfigRegistry* registry, const ConfigEntry* entry, const char* key) {
+    const char* interned = entry && key ? findInterned(registry, key) : NULL;
+    if (!interned) return NULL;
+    for (int i = 0; i < entry->propertyCount; i++) {
+        if (entry->properties[i].key == interned) return &entry->properties[i];
+    }
+    return NULL;
+}
+
+static const ConfigProperty* findConfigProperty(const ConfigEntry* entry, const char* key) {
+    return findRegistryProperty(&configRegistry, entry, key);
+}
+
+// Parse a plain decimal number (sign, digits, fraction, exponent) from the start of text.
+// strtod() alone would also take hex, "inf" and "nan"; those, and overflow, are rejected.
+static bool parseDecimal(const char* text, char** end, double* value) {
+    size_t length = 0, digits = 0;
+    if (text[length] == '+' || text[length] == '-') length++;
+    while (text[length] >= '0' && text[length] <= '9') { length++; digits++; }
+    if (text[length] == '.') {
+        length++;
+        while (text[length] >= '0' && text[length] <= '9') { length++; digits++; }
+    }
+    if (digits == 0) return false;
+    if (text[length] == 'e' || text[length] == 'E') {
+        size_t exponent = length + 1;
+        if (text[exponent] == '+' || text[exponent] == '-') exponent++;
+        if (text[exponent] >= '0' && text[exponent] <= '9') {
+            while (text[exponent] >= '0' && text[exponent] <= '9') exponent++;
+            length = exponent;
+        }
+    }
+    char number[64];
+    if (length >= sizeof(number)) return false;
+    memcpy(number, text, length);
+    number[length] = '\0';
+    *value = strtod(number, NULL);
+    *end = (char*)text + length;
+    return isfinite(*value);
+}
+
+// Parse a raw value into the narrowest type that fits; quoted text is always a string
+static bool parseConfigValue(ConfigRegistry* registry, char* text, ConfigProperty* property) {
+    size_t length = strlen(text);
+    char* end;
+    if (length >= 2 && text[0] == '"' && text[length - 1] == '"') {
+        text[length - 1] = '\0';
+        property->type = CONFIG_STRING;
+        property->value.string = internString(registry, text + 1);
+        return property->value.string != NULL;
+    }
+    if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+        property->type = CONFIG_BOOL;
+        property->value.boolean = text[0] == 't';
+        return true;
+    }
+    long long integer = strtoll(text, &end, 10);
+    if (end != text && *end == '\0') {
+        property->type = CONFIG_INT;
+        property->value.integer = integer;
+        return true;
+    }
+    double number;
+    bool isNumber = parseDecimal(text, &end, &number);
+    if (isNumber && *end == '\0') {
+        property->type = CONFIG_FLOAT;
+        property->value.number = number;
+        return true;
+    }
+    if (isNumber && (*end == ' ' || *end == ',' || *end == 'x' || *end == '\t')) {
+        char* second = end + 1;
+        while (*second == ' ' || *second == '\t' || (*second == ',' && *end != ',')) second++;
+        double y;
+        if (parseDecimal(second, &end, &y) && *end == '\0') {
+            property->type = CONFIG_VEC2;
+            property->value.vec2.x = number;
+            property->value.vec2.y = y;
+            return true;
+        }
+    }
+    property->type = CONFIG_STRING;
+    property->value.string = internString(registry, text);
+    return property->value.string != NULL;
+}
+
+static void setConfigProperty(ConfigRegistry* registry, ConfigEntry* entry, const char* key, char* rawValue) {
+    ConfigProperty property;
+    property.key = internString(registry, key);
+    if (!property.key || !parseConfigValue(registry, rawValue, &property)) return;
+    for (int i = 0; i < entry->propertyCount; i++) {
+        if (entry->properties[i].key == property.key) {
+            entry->properties[i] = property;
             return;
         }
     }
-    if (characterDefinitionCount < MAX_CHARACTER_DEF) {
-        snprintf(characterDefinitions[characterDefinitionCount].name, CHARACTER_NAME_MAX, "%s", name);
-        snprintf(characterDefinitions[characterDefinitionCount].imagePath, CHARACTER_IMAGE_MAX, "%s", imagePath);
-        characterDefinitionCount++;
+    if (entry->propertyCount == entry->propertyCapacity) {
+        int capacity = entry->propertyCapacity ? entry->propertyCapacity * 2 : 4;
+        ConfigProperty* properties = realloc(entry->properties, (size_t)capacity * sizeof(ConfigProperty));
+        if (!properties) return;
+        entry->properties = properties;
+        entry->propertyCapacity = capacity;
     }
+    entry->properties[entry->propertyCount++] = property;
 }
 
-static const char* getCharacterImagePath(const char* name, const char* fallback) {
-    for (int i = 0; i < characterDefinitionCount; i++) {
-        if (strcmp(characterDefinitions[i].name, name) == 0) return characterDefinitions[i].imagePath;
+/*
+ * Typed getters: the fallback is returned when the entry or key is missing or
+ * has another type. For floats, bools and pairs read the ConfigProperty from
+ * findConfigProperty(findConfigEntry(name), key) and switch on its type.
+ */
+static const char* getConfigString(const char* name, const char* key, const char* fallback) {
+    const ConfigProperty* property = findConfigProperty(findConfigEntry(name), key);
+    return property && property->type == CONFIG_STRING ? property->value.string : fallback;
+}
+
+static long long getConfigInt(const char* name, const char* key, long long fallback) {
+    const ConfigProperty* property = findConfigProperty(findConfigEntry(name), key);
+    return property && property->type == CONFIG_INT ? property->value.integer : fallback;
+}
+
+static void freeConfigRegistry(ConfigRegistry* registry) {
+    for (int i = 0; i < registry->entryCount; i++) free(registry->entries[i].properties);
+    free(registry->entries);
+    free(registry->table);
+    free(registry->internTable);
+    while (registry->stringBlocks) {
+        StringBlock* next = registry->stringBlocks->next;
+        free(registry->stringBlocks);
+        registry->stringBlocks = next;
     }
-    return fallback;
+    memset(registry, 0, sizeof(*registry));
+}
+
+static void destroyConfigRegistry(void) {
+    freeConfigRegistry(&configRegistry);
+}
+
+static const char* getCharacterImagePath(const char* name, const char* fallback) {
+    return getConfigString(name, "image", fallback);
 }
 
-/* Convenience wrappers (original code references these names). */
-static int readFileToMemory(const char* filePath, MemoryFile* output) { return loadFileToMemory(filePath, output); }
+/* Convenience wrapper (original code references this name). */
 static const char* getCharacterImage(const char* name, const char* fallback) { return getCharacterImagePath(name, fallback); }
 
-static void loadCharacterConfig(const char* filePath) {
-    FILE* file = fopen(filePath, "r");
-    if (!file) {
-        fprintf(stderr, "Error opening config file: %s\n", filePath);
-        return;
-    }
-    char line[256];
-    char currentName[CHARACTER_NAME_MAX] = "";
-    while (fgets(line, sizeof(line), file)) {
+// Parse config text into registry (merging into whatever it already holds). Touches no globals.
+static void parseConfig(ConfigRegistry* registry, const char* text, size_t size) {
+    const char* cursor = text;
+    const char* end = cursor + size;
+    char line[CONFIG_LINE_MAX];
+    const char* currentCategory = "";
+    ConfigEntry* currentEntry = NULL;
+    while (cursor < end) {
+        // Copy one line out of the buffer; overlong lines are truncated
+        const char* newline = memchr(cursor, '\n', (size_t)(end - cursor));
+        size_t length = (size_t)((newline ? newline : end) - cursor);
+        if (length >= sizeof(line)) length = sizeof(line) - 1;
+        memcpy(line, cursor, length);
+        line[length] = '\0';
+        cursor = newline ? newline + 1 : end;
         char* trimmedLine = ltrim(line);
         if (!*trimmedLine) continue;
         if (trimmedLine[0] == '#') {
@@ -177,93 +1232,794 @@ static void loadCharacterConfig(const char* filePath) {
             while (trimmedLine[hashCount] == '#') hashCount++;
             char* sectionName = ltrim(trimmedLine + hashCount);
             rtrim(sectionName);
-            if (hashCount == 2) {
-                snprintf(currentName, CHARACTER_NAME_MAX, "%s", sectionName);
+            if (hashCount == 1) {
+                const char* category = internString(registry, sectionName);
+                currentCategory = category ? category : "";
+                currentEntry = NULL;
+            } else if (hashCount == 2 && *sectionName) {
+                currentEntry = addConfigEntry(registry, currentCategory, sectionName);
             }
             continue;
         }
-        if (*currentName && strncmp(trimmedLine, "image", 5) == 0) {
-            char* equalsSign = strchr(trimmedLine, '=');
-            if (equalsSign) {
-                char* imagePath = ltrim(equalsSign + 1);
-                rtrim(imagePath);
-                // Strip optional surrounding quotes (e.g., "images/foo.bmp")
-                size_t len = strlen(imagePath);
-                if (len >= 2 && imagePath[0] == '"' && imagePath[len - 1] == '"') {
-                    imagePath[len - 1] = '\0';
-                    imagePath++; // move past opening quote for this call
-                }
-                addCharacterDefinition(currentName, imagePath);
-            }
+        char* equalsSign = strchr(trimmedLine, '=');
+        if (currentEntry && equalsSign) {
+            *equalsSign = '\0';
+            char* key = trimmedLine;
+            rtrim(key);
+            char* value = ltrim(equalsSign + 1);
+            rtrim(value);
+            if (*key && *value) setConfigProperty(registry, currentEntry, key, value);
         }
     }
-    fclose(file);
 }
 
-// Global camera offset
-int cameraX = 0;
-
-// Define batarong properties
-typedef struct {
-    int x, y;
-    int width, height;
-    SDL_Texture* texture; // Texture for the player
-    int velocityY; // Vertical velocity for gravity
-    bool onGround; // Check if the player is on the ground
-    bool isSprinting; // New sprint state
-    float sprintEnergy;  // New sprint energy property
-    bool facingLeft;  // New direction property
-    bool sprintKeyReleased;  // New member to track if sprint key was released
-} Batarong;
+static void loadCharacterConfig(const char* filePath) {
+    MemoryFile file;
+    if (loadAsset(filePath, &file) != 0) {
+        fprintf(stderr, "Error opening config file: %s\n", filePath);
+        return;
+    }
+    parseConfig(&configRegistry, file.data, file.size);
+    releaseMemoryFile(&file);
+}
 
-// Define platform properties
+/*
+ * Texture cache. Images are requested by config asset name (the "## name"
+ * entries of config/config.md); the name is resolved with getCharacterImage()
+ * and each resolved file is decoded and uploaded once, however many names or
+ * entities share it. acquireSprite() hands out the shared sprite and counts
+ * the reference, releaseSprite() drops it. Unreferenced sprites stay resident
+ * so reopening e.g. a dialog portrait never touches the disk;
+ * destroyTextureCache() frees everything at shutdown.
+ *
+ * At startup loadAssets() reads and decodes every config image (plus the
+ * startup fallbacks) on a small worker pool while the loading screen shows
+ * real progress; the render thread then shelf-packs every non-background
+ * image into a few SPRITE_ATLAS_SIZE pages and uploads them, so most sprites
+ * are sub-rects of one texture and world sprites batch into a single draw.
+ */
 typedef struct {
-    int x, y;
-    SDL_Rect rect; // Rectangle for the platform
-} Platform;
+    SDL_Texture* texture;   // Atlas page or standalone texture
+    SDL_Rect src;           // Where the image sits in texture
+} Sprite;
 
-// Define piwo properties
 typedef struct {
-    int x, y;
-    SDL_Texture* texture; // Texture for the piwo
-    bool collected; // Check if the piwo has been collected
-} Piwo;
-
-// Add gambling machine state
+    char path[CHARACTER_IMAGE_MAX];  // Resolved image path (the cache key)
+    Sprite sprite;
+    bool ownsTexture;                // false when sprite.texture is a shared atlas page
+    int refCount;
+} TextureCacheEntry;
+
+static TextureCacheEntry textureCache[MAX_CACHED_TEXTURES];
+static int textureCacheCount = 0;
+static SDL_Texture* atlasPages[MAX_ATLAS_PAGES];
+static int atlasPageCount = 0;
+
+/*
+ * Pixel cache. Every decoded image is also written to PIXEL_CACHE_DIR as raw
+ * rows already converted to assetPixelFormat (the renderer's preferred 32-bit
+ * format), so a warm start maps those rows and uploads them with
+ * SDL_UpdateTexture: no BMP decoding and no conversion inside SDL. An entry
+ * records its source's size, nanosecond mtime and FNV-1a content hash. A
+ * matching size and mtime is trusted without touching the source; otherwise
+ * the source is hashed and the entry is restamped if the bytes are unchanged
+ * or rebuilt if they changed, so editing anything under images/ needs no
+ * manual step. Sources modified in the last PIXEL_CACHE_SETTLE_SECONDS are
+ * always hashed, since a filesystem with coarse timestamps can give two quick
+ * saves the same mtime.
+ */
 typedef struct {
-    int x, y;
-    SDL_Texture* texture;
-} GamblingMachine;
+    char magic[4];
+    Uint32 version;
+    Uint32 format;          // SDL_PIXELFORMAT_* of the rows
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+    Uint64 sourceHash;
+    Sint64 sourceMtime;     // Nanoseconds; 0 when the platform can't tell
+    Uint64 sourceSize;
+    char source[CHARACTER_IMAGE_MAX]; // Guards against cache-name collisions
+} PixelCacheHeader;         // Followed by height * pitch bytes of pixels
+
+static Uint32 assetPixelFormat = SDL_PIXELFORMAT_ARGB8888;
+
+// Prefer the renderer's first 32-bit format with alpha so uploads are plain copies
+static void choosePixelFormat(SDL_Renderer* renderer) {
+    SDL_RendererInfo info;
+    assetPixelFormat = SDL_PIXELFORMAT_ARGB8888;
+    if (SDL_GetRendererInfo(renderer, &info) != 0) return;
+    for (Uint32 i = 0; i < info.num_texture_formats; i++) {
+        Uint32 format = info.texture_formats[i];
+        if (!SDL_ISPIXELFORMAT_FOURCC(format) && SDL_BYTESPERPIXEL(format) == 4 && SDL_ISPIXELFORMAT_ALPHA(format)) {
+            assetPixelFormat = format;
+            return;
+        }
+    }
+}
 
-// Add after other struct definitions
-typedef struct {
-    char text[32];
-    int length;
-    int maxLength;
-} TextInput;
+static bool fileExists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file) fclose(file);
+    return file != NULL;
+}
 
-typedef struct {
-    int x, y;
-    SDL_Texture* texture;
-} Ray;
+// Modification time (nanoseconds) and size of whatever loadAsset() will read for path: the pack
+// or the loose file. 0 when unknown or too recent to trust, so the caller hashes the source instead.
+static Sint64 sourceModifiedTime(const char* path, Uint64* size) {
+    *size = 0;
+#ifdef HAVE_MMAP
+    const char* file = assetPack.data && assetPackFind(assetPack.data, path) ? ASSET_PACK_PATH : path;
+    struct stat info;
+    if ((looseFilesFirst && stat(path, &info) == 0) || stat(file, &info) == 0) {
+        if ((Sint64)time(NULL) - (Sint64)info.st_mtime < PIXEL_CACHE_SETTLE_SECONDS) return 0;
+        *size = (Uint64)info.st_size;
+        return (Sint64)info.st_mtime * 1000000000 + (Sint64)STAT_MTIME_NSEC(info);
+    }
+#else
+    (void)path;
+#endif
+    return 0;
+}
 
-typedef struct {
-    char name[SHOP_ITEM_NAME_MAX];
-    int price;
-    bool purchased;
-} ShopItem;
+// Map a cache entry if it matches the source by mtime and size (when mtime is nonzero) or hash (when nonzero)
+static SDL_Surface* mapPixelCache(const char* cachePath, const char* source, Sint64 mtime, Uint64 size, Uint64 hash,
+                                  MemoryFile* pixels) {
+    if (mapFileToMemory(cachePath, pixels) != 0) return NULL;
+    const PixelCacheHeader* header = (const PixelCacheHeader*)pixels->data;
+    bool valid = pixels->size >= sizeof(PixelCacheHeader) &&
+                 memcmp(header->magic, PIXEL_CACHE_MAGIC, 4) == 0 &&
+                 header->version == PIXEL_CACHE_VERSION &&
+                 header->format == assetPixelFormat &&
+                 strncmp(header->source, source, CHARACTER_IMAGE_MAX) == 0 &&
+                 header->width > 0 && header->height > 0 && header->width <= INT32_MAX / 4 &&
+                 header->pitch >= header->width * 4 &&
+                 sizeof(PixelCacheHeader) + (Uint64)header->pitch * header->height == pixels->size &&
+                 ((mtime != 0 && header->sourceMtime == mtime && header->sourceSize == size) ||
+                  (hash != 0 && header->sourceHash == hash));
+    SDL_Surface* surface = valid ? SDL_CreateRGBSurfaceWithFormatFrom((unsigned char*)pixels->data + sizeof(PixelCacheHeader),
+                                                                      (int)header->width, (int)header->height, 32,
+                                                                      (int)header->pitch, header->format) : NULL;
+    if (!surface) releaseMemoryFile(pixels);
+    return surface;
+}
 
-#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
-_Static_assert(SHOP_ITEM_NAME_MAX + 40 < 128, "weird ass error in code, proceed with caution.");
+// Write through a temporary file so a crash or a concurrent reader never sees a partial entry
+static void writePixelCache(const char* cachePath, const char* source, const SDL_Surface* surface, Sint64 mtime, Uint64 size,
+                            Uint64 hash) {
+#ifdef HAVE_MMAP
+    mkdir(PIXEL_CACHE_DIR, 0755);
 #endif
+    PixelCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PIXEL_CACHE_MAGIC, 4);
+    header.version = PIXEL_CACHE_VERSION;
+    header.format = surface->format->format;
+    header.width = (Uint32)surface->w;
+    header.height = (Uint32)surface->h;
+    header.pitch = (Uint32)surface->pitch;
+    header.sourceHash = hash;
+    header.sourceMtime = mtime;
+    header.sourceSize = size;
+    snprintf(header.source, sizeof(header.source), "%s", source);
+
+    char tempPath[CHARACTER_IMAGE_MAX + 16];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachePath);
+    FILE* file = fopen(tempPath, "wb");
+    if (!file) return; // No cache dir (read-only install): just decode every start
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(surface->pixels, (size_t)surface->pitch, (size_t)surface->h, file) == (size_t)surface->h;
+    if (fclose(file) != 0 || !written) {
+        remove(tempPath);
+        return;
+    }
+    if (rename(tempPath, cachePath) != 0) {
+        remove(cachePath);
+        if (rename(tempPath, cachePath) != 0) remove(tempPath);
+    }
+}
 
-// Add after other struct definitions
+/*
+ * Decode an image into assetPixelFormat, through the pixel cache. The surface
+ * may point into *pixels (a mapped cache entry): free the surface first, then
+ * releaseMemoryFile(pixels). File and surface work only; safe off the render thread.
+ */
+static SDL_Surface* decodeImage(const char* path, MemoryFile* pixels) {
+    memset(pixels, 0, sizeof(*pixels));
+    char cachePath[CHARACTER_IMAGE_MAX];
+    snprintf(cachePath, sizeof(cachePath), PIXEL_CACHE_DIR "/%08x.pix", (unsigned)hashText(path));
+    Uint64 size;
+    Sint64 mtime = sourceModifiedTime(path, &size);
+    bool cached = fileExists(cachePath);
+    SDL_Surface* surface = cached && mtime != 0 ? mapPixelCache(cachePath, path, mtime, size, 0, pixels) : NULL;
+    if (surface) return surface;
+
+    MemoryFile source;
+    if (loadAsset(path, &source) != 0) return NULL;
+    Uint64 hash = hashBytes(source.data, source.size);
+    surface = cached ? mapPixelCache(cachePath, path, 0, 0, hash, pixels) : NULL;
+    if (surface) {
+        // Same bytes, new mtime (e.g. a fresh checkout or make pack): restamp so the next start skips hashing
+        if (mtime != 0) writePixelCache(cachePath, path, surface, mtime, size, hash);
+    } else {
+        SDL_RWops* rw = SDL_RWFromConstMem(source.data, (int)source.size);
+        SDL_Surface* loaded = rw ? SDL_LoadBMP_RW(rw, 1) : NULL;
+        surface = loaded ? SDL_ConvertSurfaceFormat(loaded, assetPixelFormat, 0) : NULL;
+        if (loaded) SDL_FreeSurface(loaded);
+        if (surface) writePixelCache(cachePath, path, surface, mtime, size, hash);
+    }
+    releaseMemoryFile(&source);
+    return surface;
+}
+
+// Upload rows that are already in a texture format, so SDL copies instead of converting
+static SDL_Texture* createStaticTexture(SDL_Renderer* renderer, SDL_Surface* surface) {
+    TRACE_BEGIN("uploadTexture");
+    SDL_Texture* texture = SDL_CreateTexture(renderer, surface->format->format, SDL_TEXTUREACCESS_STATIC, surface->w, surface->h);
+    if (texture && SDL_UpdateTexture(texture, NULL, surface->pixels, surface->pitch) != 0) {
+        SDL_DestroyTexture(texture);
+        texture = NULL;
+    }
+    if (texture) SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    TRACE_END("uploadTexture");
+    return texture;
+}
+
+static TextureCacheEntry* findCachedTexture(const char* path) {
+    for (int i = 0; i < textureCacheCount; i++) {
+        if (strcmp(textureCache[i].path, path) == 0) return &textureCache[i];
+    }
+    return NULL;
+}
+
+static TextureCacheEntry* addCachedTexture(const char* path, Sprite sprite, bool ownsTexture) {
+    if (textureCacheCount == MAX_CACHED_TEXTURES) {
+        printf("Texture cache full, not loading %s\n", path);
+        return NULL;
+    }
+    TextureCacheEntry* entry = &textureCache[textureCacheCount++];
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->sprite = sprite;
+    entry->ownsTexture = ownsTexture;
+    entry->refCount = 0;
+    return entry;
+}
+
+// Decode an asset into the cache without taking a reference; returns NULL on failure
+static TextureCacheEntry* cacheTexture(SDL_Renderer* renderer, const char* name, const char* fallback) {
+    const char* path = getCharacterImage(name, fallback);
+    if (!path || !*path) return NULL;
+    TextureCacheEntry* entry = findCachedTexture(path);
+    if (entry) return entry;
+    if (textureCacheCount == MAX_CACHED_TEXTURES) {
+        printf("Texture cache full, not loading %s\n", path);
+        return NULL;
+    }
+    MemoryFile pixels;
+    TRACE_BEGIN_ARG("decodeImage", path);
+    SDL_Surface* surface = decodeImage(path, &pixels);
+    TRACE_END("decodeImage");
+    if (!surface) return NULL;
+    Sprite sprite = { createStaticTexture(renderer, surface), { 0, 0, surface->w, surface->h } };
+    SDL_FreeSurface(surface);
+    releaseMemoryFile(&pixels);
+    if (!sprite.texture) return NULL;
+    return addCachedTexture(path, sprite, true);
+}
+
+static Sprite acquireSprite(SDL_Renderer* renderer, const char* name, const char* fallback) {
+    TextureCacheEntry* entry = cacheTexture(renderer, name, fallback);
+    if (!entry) return (Sprite){ NULL, { 0, 0, 0, 0 } };
+    entry->refCount++;
+    return entry->sprite;
+}
+
+static bool sameSprite(Sprite a, Sprite b) {
+    return a.texture == b.texture && a.src.x == b.src.x && a.src.y == b.src.y;
+}
+
+// Cache entry a handed-out sprite came from
+static TextureCacheEntry* findSpriteEntry(Sprite sprite) {
+    if (!sprite.texture) return NULL;
+    for (int i = 0; i < textureCacheCount; i++) {
+        if (sameSprite(textureCache[i].sprite, sprite)) return &textureCache[i];
+    }
+    return NULL;
+}
+
+static void releaseSprite(Sprite sprite) {
+    TextureCacheEntry* entry = findSpriteEntry(sprite);
+    if (entry && entry->refCount > 0) entry->refCount--;
+}
+
+// Image wanted at startup: config name with a fallback path when it isn't configured
 typedef struct {
-    int x, y;
-    bool active;
-    bool direction;  // true = left, false = right
-} Bullet;
+    const char* name;
+    const char* fallback;
+    bool atlas;             // Pack into the sprite atlas when not configured (configured entries go by category)
+} AssetRequest;
+
+// One file to read and decode; surface is written by a worker, then owned by the render thread
+typedef struct {
+    char path[CHARACTER_IMAGE_MAX];
+    bool atlas;
+    SDL_Surface* surface;   // assetPixelFormat so atlas blits copy pixels verbatim; NULL if loading failed
+    MemoryFile pixels;      // Mapped pixel cache entry the surface may point into
+    int page;               // Atlas page, -1 when not packed
+    SDL_Rect rect;
+} AssetJob;
+
+static AssetJob assetJobs[MAX_CACHED_TEXTURES];
+static int assetJobCount = 0;
+static SDL_atomic_t assetNextJob;
+static SDL_atomic_t assetJobsDone;
+static SDL_mutex* assetMutex = NULL;
+static SDL_cond* assetCond = NULL;     // Signalled after every finished job
+
+static void addAssetJob(const char* path, bool atlas) {
+    if (!path || !*path || findCachedTexture(path)) return;
+    for (int i = 0; i < assetJobCount; i++) {
+        if (strcmp(assetJobs[i].path, path) == 0) {
+            assetJobs[i].atlas = assetJobs[i].atlas && atlas; // A full-screen use keeps it standalone
+            return;
+        }
+    }
+    if (assetJobCount == MAX_CACHED_TEXTURES) return;
+    AssetJob* job = &assetJobs[assetJobCount++];
+    memset(job, 0, sizeof(*job));
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->atlas = atlas;
+    job->page = -1;
+}
+
+static void decodeAssetJob(AssetJob* job) {
+    TRACE_BEGIN_ARG("decodeImage", job->path);
+    job->surface = decodeImage(job->path, &job->pixels);
+    TRACE_END("decodeImage");
+    job->rect = (SDL_Rect){ 0, 0, job->surface ? job->surface->w : 0, job->surface ? job->surface->h : 0 };
+}
+
+// Worker: claim jobs until none are left
+static int assetWorker(void* data) {
+    (void)data;
+    TRACE_THREAD("asset-loader");
+    for (;;) {
+        int i = SDL_AtomicAdd(&assetNextJob, 1);
+        if (i >= assetJobCount) break;
+        decodeAssetJob(&assetJobs[i]);
+        SDL_LockMutex(assetMutex);
+        SDL_AtomicAdd(&assetJobsDone, 1);
+        SDL_CondBroadcast(assetCond);
+        SDL_UnlockMutex(assetMutex);
+    }
+    return 0;
+}
+
+static int compareAtlasHeight(const void* a, const void* b) {
+    const AssetJob* ja = *(const AssetJob* const*)a;
+    const AssetJob* jb = *(const AssetJob* const*)b;
+    if (ja->rect.h != jb->rect.h) return jb->rect.h - ja->rect.h;
+    return strcmp(ja->path, jb->path); // Same layout on every run
+}
+
+// Render thread: pack decoded atlas images into shared pages and upload them
+static void buildSpriteAtlas(SDL_Renderer* renderer) {
+    AssetJob* images[MAX_CACHED_TEXTURES];
+    int imageCount = 0;
+    for (int i = 0; i < assetJobCount; i++) {
+        if (assetJobs[i].atlas && assetJobs[i].surface) images[imageCount++] = &assetJobs[i];
+    }
+    if (imageCount == 0) return;
+
+    int pageSize = SPRITE_ATLAS_SIZE;
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0) {
+        if (info.max_texture_width < pageSize) pageSize = info.max_texture_width;
+        if (info.max_texture_height > 0 && info.max_texture_height < pageSize) pageSize = info.max_texture_height;
+    }
+
+    // Shelf packing, tallest first; images that don't fit a page keep their own texture
+    qsort(images, (size_t)imageCount, sizeof(AssetJob*), compareAtlasHeight);
+    int pageHeights[MAX_ATLAS_PAGES] = {0};
+    int pages = 0, penX = 0, penY = 0, shelfHeight = 0;
+    for (int i = 0; i < imageCount; i++) {
+        int w = images[i]->rect.w + SPRITE_ATLAS_PADDING, h = images[i]->rect.h + SPRITE_ATLAS_PADDING;
+        if (w > pageSize || h > pageSize) continue;
+        if (pages == 0 || penX + w > pageSize) {
+            penX = 0;
+            penY += shelfHeight;
+            shelfHeight = 0;
+        }
+        if (pages == 0 || penY + h > pageSize) {
+            if (pages == MAX_ATLAS_PAGES) continue;
+            pages++;
+            penX = penY = shelfHeight = 0;
+        }
+        images[i]->page = pages - 1;
+        images[i]->rect.x = penX;
+        images[i]->rect.y = penY;
+        penX += w;
+        if (h > shelfHeight) shelfHeight = h;
+        if (penY + h > pageHeights[pages - 1]) pageHeights[pages - 1] = penY + h;
+    }
+
+    for (int page = 0; page < pages; page++) {
+        SDL_Surface* sheet = SDL_CreateRGBSurfaceWithFormat(0, pageSize, pageHeights[page], 32, assetPixelFormat);
+        SDL_Texture* texture = NULL;
+        if (sheet) {
+            for (int i = 0; i < imageCount; i++) {
+                if (images[i]->page != page) continue;
+                SDL_Rect dst = images[i]->rect;
+                SDL_SetSurfaceBlendMode(images[i]->surface, SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(images[i]->surface, NULL, sheet, &dst);
+            }
+            texture = createStaticTexture(renderer, sheet);
+            SDL_FreeSurface(sheet);
+        }
+        if (!texture) {
+            printf("Unable to create sprite atlas page: %s\n", SDL_GetError());
+            for (int i = 0; i < imageCount; i++) {
+                if (images[i]->page == page) images[i]->page = -1; // Fall back to its own texture
+            }
+            continue;
+        }
+        atlasPages[atlasPageCount++] = texture;
+        for (int i = 0; i < imageCount; i++) {
+            if (images[i]->page == page) addCachedTexture(images[i]->path, (Sprite){ texture, images[i]->rect }, false);
+        }
+    }
+}
+
+/*
+ * Read and decode every configured image plus the startup requests on a worker
+ * pool, showing real progress on the loading screen, then upload on this
+ * (render) thread. Afterwards acquireSprite() for any of them is a cache hit.
+ */
+static void loadAssets(SDL_Renderer* renderer, TTF_Font* font, const AssetRequest* requests, int requestCount) {
+    assetJobCount = 0;
+    choosePixelFormat(renderer);
+    for (int i = 0; i < configRegistry.entryCount; i++) {
+        const ConfigEntry* entry = &configRegistry.entries[i];
+        const ConfigProperty* image = findConfigProperty(entry, "image");
+        if (image && image->type == CONFIG_STRING) addAssetJob(image->value.string, strcmp(entry->category, SPRITE_ATLAS_EXCLUDE) != 0);
+    }
+    for (int i = 0; i < requestCount; i++) {
+        const char* path = getCharacterImage(requests[i].name, NULL);
+        if (!path) addAssetJob(requests[i].fallback, requests[i].atlas);
+    }
+    SDL_AtomicSet(&assetNextJob, 0);
+    SDL_AtomicSet(&assetJobsDone, 0);
+
+    SDL_Thread* workers[ASSET_LOADER_THREADS];
+    int workerCount = 0;
+    int wanted = SDL_GetCPUCount();
+    if (wanted > ASSET_LOADER_THREADS) wanted = ASSET_LOADER_THREADS;
+    if (wanted > assetJobCount) wanted = assetJobCount;
+    assetMutex = SDL_CreateMutex();
+    assetCond = SDL_CreateCond();
+    if (assetMutex && assetCond) {
+        while (workerCount < wanted) {
+            SDL_Thread* thread = SDL_CreateThread(assetWorker, "asset-loader", NULL);
+            if (!thread) break;
+            workers[workerCount++] = thread;
+        }
+    }
+    // Redraw the bar whenever another file finishes
+    int shown = -1;
+    for (;;) {
+        int done = SDL_AtomicGet(&assetJobsDone);
+        if (done != shown) {
+            renderLoadingScreen(renderer, font, "Loading assets", done, assetJobCount);
+            shown = done;
+        }
+        if (done >= assetJobCount) break;
+        if (workerCount == 0) {
+            // No threads: decode inline, still redrawing after each file
+            decodeAssetJob(&assetJobs[done]);
+            SDL_AtomicAdd(&assetJobsDone, 1);
+            continue;
+        }
+        SDL_LockMutex(assetMutex);
+        while (SDL_AtomicGet(&assetJobsDone) == done) SDL_CondWait(assetCond, assetMutex);
+        SDL_UnlockMutex(assetMutex);
+    }
+    for (int i = 0; i < workerCount; i++) SDL_WaitThread(workers[i], NULL);
+    if (assetCond) SDL_DestroyCond(assetCond);
+    if (assetMutex) SDL_DestroyMutex(assetMutex);
+    assetCond = NULL;
+    assetMutex = NULL;
+
+    // Uploads: atlas pages first, then whatever stays standalone
+    renderLoadingScreen(renderer, font, "Uploading textures", assetJobCount, assetJobCount);
+    TRACE("buildSpriteAtlas", buildSpriteAtlas(renderer));
+    for (int i = 0; i < assetJobCount; i++) {
+        AssetJob* job = &assetJobs[i];
+        if (!job->surface) {
+            printf("Unable to load %s\n", job->path);
+            continue;
+        }
+        if (job->page < 0) {
+            Sprite sprite = { createStaticTexture(renderer, job->surface), { 0, 0, job->surface->w, job->surface->h } };
+            if (sprite.texture) addCachedTexture(job->path, sprite, true);
+        }
+        SDL_FreeSurface(job->surface);
+        releaseMemoryFile(&job->pixels);
+        job->surface = NULL;
+    }
+    assetJobCount = 0;
+}
+
+static void destroyTextureCache(void) {
+    for (int i = 0; i < textureCacheCount; i++) {
+        if (textureCache[i].refCount > 0) printf("Texture %s still has %d references at shutdown\n", textureCache[i].path, textureCache[i].refCount);
+        if (textureCache[i].ownsTexture) SDL_DestroyTexture(textureCache[i].sprite.texture);
+    }
+    for (int i = 0; i < atlasPageCount; i++) SDL_DestroyTexture(atlasPages[i]);
+    memset(textureCache, 0, sizeof(textureCache));
+    memset(atlasPages, 0, sizeof(atlasPages));
+    textureCacheCount = atlasPageCount = 0;
+}
+
+// Global camera offset (render camera, follows the interpolated player)
+int cameraX = 0;
+// Camera as seen by the simulation; only updated on fixed ticks
+int simCameraX = 0;
+
+// Fixed-step simulation clock
+Uint32 simTickCount = 0;
+
+// Buttons sampled once per tick; the simulation never reads the keyboard directly
+#define INPUT_LEFT   (1u << 0)
+#define INPUT_RIGHT  (1u << 1)
+#define INPUT_UP     (1u << 2)
+#define INPUT_SPRINT (1u << 3)
+#define INPUT_A      (1u << 4)
+#define INPUT_B      (1u << 5)
+#define INPUT_ESC    (1u << 6)
+#define INPUT_SHOOT  (1u << 7)
+#define INPUT_RESTART (1u << 8)
+#define INPUT_SHOP_1 (1u << 9)
+#define INPUT_SHOP_2 (1u << 10)
+#define INPUT_SHOP_3 (1u << 11)
+#define INPUT_REWIND (1u << 12)     // Held: the main loop steps back instead of simulating
+
+typedef struct {
+    Uint16 buttons;
+    Uint8 keyCount;             // Bet keys typed since the last tick: '0'-'9' or '\b'
+    char keys[INPUT_KEY_MAX];
+} InputState;
+
+static Uint32 simTimeMs(void) {
+    return (Uint32)((Uint64)simTickCount * 1000 / SIM_TICK_HZ);
+}
+
+// Simulation RNG. Reseeded from simRngSeed on every reset so a recording replays
+// exactly; game logic must draw from here, never rand().
+static Uint32 simRngSeed = SIM_DEFAULT_SEED;
+static Uint32 simRngState = SIM_DEFAULT_SEED;
+
+static Uint32 simRandom(void) {
+    simRngState = simRngState * 1664525u + 1013904223u;
+    return simRngState >> 8;
+}
+
+// Define batarong properties
+typedef struct {
+    float x, y;
+    int width, height;
+    Sprite sprite; // Player image
+    float velocityY; // Vertical velocity for gravity (pixels per tick)
+    bool onGround; // Check if the player is on the ground
+    bool isSprinting; // New sprint state
+    float sprintEnergy;  // New sprint energy property
+    bool facingLeft;  // New direction property
+    bool sprintKeyReleased;  // New member to track if sprint key was released
+    float prevX, prevY;  // Position at the start of the current tick, for render interpolation
+    float velocityX;     // Horizontal move requested by input this tick (pixels per tick)
+} Batarong;
+
+// Add after other struct definitions
+typedef struct {
+    char text[32];
+    int length;
+    int maxLength;
+} TextInput;
+
+typedef struct {
+    char name[SHOP_ITEM_NAME_MAX];
+    int price;
+    bool purchased;
+} ShopItem;
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+_Static_assert(SHOP_ITEM_NAME_MAX + 40 < 128, "weird ass error in code, proceed with caution.");
+#endif
+
+/*
+ * Entity store. Entities spawned at runtime (bullets so far) live in
+ * structure-of-arrays columns that grow on demand, so there is no
+ * compile-time cap. Live entities are packed into rows [0, count): systems
+ * loop over just the columns they touch, and removal swaps the last row
+ * into the hole. Rows move, so anything held across ticks uses an
+ * EntityHandle (slot + generation). The slot table maps handles to rows,
+ * freed slots are reused from a free list, and a stale handle never
+ * resolves because its generation no longer matches.
+ */
+typedef struct {
+    Uint32 slot;
+    Uint32 generation;      // 0 is never issued, so a zeroed handle is always invalid
+} EntityHandle;
+
+enum {
+    ENTITY_FACING_LEFT = 1u << 0,
+};
+
+typedef struct {
+    // Hot columns, one row per live entity
+    float* x;
+    float* y;
+    float* prevX;           // Position at the start of the current tick
+    float* prevY;
+    float* vx;              // Pixels per tick
+    float* vy;
+    float* w;
+    float* h;
+    Uint32* flags;
+    Uint32* rowSlot;        // Row -> slot, to fix up the slot table when rows move
+    int count;
+    int capacity;
+    // Handle table
+    Uint32* slotRow;
+    Uint32* slotGeneration;
+    Uint32* freeSlots;
+    int freeCount;
+    int slotCount;
+    int slotCapacity;
+} EntityStore;
+
+static bool growColumn(void** column, size_t elementSize, int capacity) {
+    void* grown = realloc(*column, elementSize * (size_t)capacity);
+    if (!grown) return false;
+    *column = grown;
+    return true;
+}
+
+static bool reserveEntityRows(EntityStore* store, int needed) {
+    if (needed <= store->capacity) return true;
+    int capacity = store->capacity ? store->capacity : ENTITY_STORE_MIN_CAPACITY;
+    while (capacity < needed) capacity *= 2;
+    if (!growColumn((void**)&store->x, sizeof(float), capacity) ||
+        !growColumn((void**)&store->y, sizeof(float), capacity) ||
+        !growColumn((void**)&store->prevX, sizeof(float), capacity) ||
+        !growColumn((void**)&store->prevY, sizeof(float), capacity) ||
+        !growColumn((void**)&store->vx, sizeof(float), capacity) ||
+        !growColumn((void**)&store->vy, sizeof(float), capacity) ||
+        !growColumn((void**)&store->w, sizeof(float), capacity) ||
+        !growColumn((void**)&store->h, sizeof(float), capacity) ||
+        !growColumn((void**)&store->flags, sizeof(Uint32), capacity) ||
+        !growColumn((void**)&store->rowSlot, sizeof(Uint32), capacity)) return false;
+    store->capacity = capacity;
+    return true;
+}
+
+static bool reserveEntitySlot(EntityStore* store) {
+    if (store->freeCount > 0 || store->slotCount < store->slotCapacity) return true;
+    int capacity = store->slotCapacity ? store->slotCapacity * 2 : ENTITY_STORE_MIN_CAPACITY;
+    if (!growColumn((void**)&store->slotRow, sizeof(Uint32), capacity) ||
+        !growColumn((void**)&store->slotGeneration, sizeof(Uint32), capacity) ||
+        !growColumn((void**)&store->freeSlots, sizeof(Uint32), capacity)) return false;
+    store->slotCapacity = capacity;
+    return true;
+}
+
+// New entity at rest with the given box; returns an invalid handle if out of memory
+static EntityHandle spawnEntity(EntityStore* store, float x, float y, float w, float h) {
+    if (!reserveEntityRows(store, store->count + 1) || !reserveEntitySlot(store)) return (EntityHandle){ 0, 0 };
+    Uint32 slot;
+    if (store->freeCount > 0) {
+        slot = store->freeSlots[--store->freeCount];
+    } else {
+        slot = (Uint32)store->slotCount++;
+        store->slotGeneration[slot] = 1;
+    }
+    int row = store->count++;
+    store->x[row] = store->prevX[row] = x;
+    store->y[row] = store->prevY[row] = y;
+    store->vx[row] = store->vy[row] = 0.0f;
+    store->w[row] = w;
+    store->h[row] = h;
+    store->flags[row] = 0;
+    store->rowSlot[row] = slot;
+    store->slotRow[slot] = (Uint32)row;
+    return (EntityHandle){ slot, store->slotGeneration[slot] };
+}
+
+// Current row of a handle, or -1 if the entity is gone
+static int entityRow(const EntityStore* store, EntityHandle handle) {
+    if (handle.slot >= (Uint32)store->slotCount || store->slotGeneration[handle.slot] != handle.generation) return -1;
+    return (int)store->slotRow[handle.slot];
+}
+
+// Remove a row; the last row moves into it, so loops that remove must not advance past row
+static void removeEntityRow(EntityStore* store, int row) {
+    Uint32 slot = store->rowSlot[row];
+    if (++store->slotGeneration[slot] == 0) store->slotGeneration[slot] = 1;
+    store->freeSlots[store->freeCount++] = slot;
+    int last = --store->count;
+    if (row != last) {
+        store->x[row] = store->x[last];
+        store->y[row] = store->y[last];
+        store->prevX[row] = store->prevX[last];
+        store->prevY[row] = store->prevY[last];
+        store->vx[row] = store->vx[last];
+        store->vy[row] = store->vy[last];
+        store->w[row] = store->w[last];
+        store->h[row] = store->h[last];
+        store->flags[row] = store->flags[last];
+        store->rowSlot[row] = store->rowSlot[last];
+        store->slotRow[store->rowSlot[row]] = (Uint32)row;
+    }
+}
+
+// Move every row by its velocity. Kept branch-free over restrict columns so it vectorises.
+static void integrateEntities(EntityStore* store) {
+    float* restrict x = store->x;
+    float* restrict y = store->y;
+    const float* restrict vx = store->vx;
+    const float* restrict vy = store->vy;
+    const int count = store->count;
+    for (int i = 0; i < count; i++) {
+        x[i] += vx[i];
+        y[i] += vy[i];
+    }
+}
+
+// Remove every entity (handles all go stale); keeps the allocations
+static void clearEntityStore(EntityStore* store) {
+    while (store->count > 0) removeEntityRow(store, store->count - 1);
+}
+
+static void freeEntityStore(EntityStore* store) {
+    free(store->x);
+    free(store->y);
+    free(store->prevX);
+    free(store->prevY);
+    free(store->vx);
+    free(store->vy);
+    free(store->w);
+    free(store->h);
+    free(store->flags);
+    free(store->rowSlot);
+    free(store->slotRow);
+    free(store->slotGeneration);
+    free(store->freeSlots);
+    memset(store, 0, sizeof(*store));
+}
+
+/*
+ * Sections of a save state and of a rewind image (see "Save states" below).
+ * Code that changes the piwo, gambling or dialog state marks its section with
+ * markSaveDirty(), so rewindPush() captures only what changed since the last
+ * tick. The player, world and bullets change nearly every tick and are always
+ * captured.
+ */
+enum {
+    SAVE_PLAYER,
+    SAVE_WORLD,
+    SAVE_GAMBLING,
+    SAVE_DIALOG,
+    SAVE_PIWO,      // piwoCollected[piwoListCount]
+    SAVE_BULLETS,   // Uint32 count, then a SaveBullet per bullet. Last: the only section that resizes in play
+    SAVE_SECTION_COUNT
+};
+
+#define SAVE_ALL_SECTIONS ((1u << SAVE_SECTION_COUNT) - 1)
+#define SAVE_TICK_SECTIONS ((1u << SAVE_PLAYER) | (1u << SAVE_WORLD) | (1u << SAVE_BULLETS))
 
+static Uint32 saveDirtySections = SAVE_ALL_SECTIONS;  // Bits of sections changed since rewindPush() captured them
+
+static void markSaveDirty(int section) {
+    saveDirtySections |= 1u << section;
+}
 
 typedef struct {
     char lines[DIALOG_MAX_LINES][DIALOG_LINE_MAX];
@@ -273,7 +2029,8 @@ typedef struct {
     bool freeze_movement;
     bool portrait_visible;
     bool speaker_visible;
-    SDL_Texture* portrait_tex;
+    Sprite portrait;
+    char portraitKey[CHARACTER_NAME_MAX];  // Config name of portrait, for hot reload
     char speaker[CHARACTER_NAME_MAX];
 } DialogState;
 
@@ -290,7 +2047,8 @@ void dialog_start(const char** lines, int lineCount,
                   SDL_Renderer* renderer) {
     if (!lines || lineCount <= 0) return;
     if (lineCount > DIALOG_MAX_LINES) lineCount = DIALOG_MAX_LINES;
-    if (dialogState.portrait_tex) { SDL_DestroyTexture(dialogState.portrait_tex); dialogState.portrait_tex = NULL; }
+    markSaveDirty(SAVE_DIALOG);
+    if (dialogState.portrait.texture) { releaseSprite(dialogState.portrait); dialogState.portrait.texture = NULL; }
     memset(&dialogState, 0, sizeof(dialogState));
     for (int i = 0; i < lineCount; i++) if (lines[i]) snprintf(dialogState.lines[i], DIALOG_LINE_MAX, "%.*s", DIALOG_LINE_MAX - 1, lines[i]);
     dialogState.totalLines = lineCount;
@@ -301,17 +2059,11 @@ void dialog_start(const char** lines, int lineCount,
     dialogState.speaker_visible = speaker_visible && speakerName && *speakerName;
     if (dialogState.speaker_visible) snprintf(dialogState.speaker, CHARACTER_NAME_MAX, "%.*s", CHARACTER_NAME_MAX - 1, speakerName);
     if (portrait_visible && portraitKey && *portraitKey && renderer) {
-        const char* path = getCharacterImage(portraitKey, "images/batarong.bmp");
-        MemoryFile mem = {0};
-        if (readFileToMemory(path, &mem) == 0) {
-            SDL_RWops* rw = SDL_RWFromConstMem(mem.data, (int)mem.size);
-            SDL_Surface* surf = rw ? SDL_LoadBMP_RW(rw, 1) : NULL;
-            if (surf) {
-                dialogState.portrait_tex = SDL_CreateTextureFromSurface(renderer, surf);
-                SDL_FreeSurface(surf);
-            }
-            free(mem.data);
-        }
+        // Shared with the rest of the game through the texture cache (preloaded, so no disk access here)
+        TRACE_BEGIN_ARG("dialog portrait", portraitKey);
+        dialogState.portrait = acquireSprite(renderer, portraitKey, "images/batarong.bmp");
+        TRACE_END("dialog portrait");
+        snprintf(dialogState.portraitKey, CHARACTER_NAME_MAX, "%s", portraitKey);
     }
 }
 
@@ -319,15 +2071,17 @@ void dialog_start_simple(const char** lines, int lineCount) { dialog_start(lines
 
 void dialog_next(void) {
     if (!dialogState.active) return;
+    markSaveDirty(SAVE_DIALOG);
     dialogState.currentIndex++;
     if (dialogState.currentIndex >= dialogState.totalLines) {
         dialogState.active = false;
-        if (dialogState.portrait_tex) { SDL_DestroyTexture(dialogState.portrait_tex); dialogState.portrait_tex = NULL; }
+        if (dialogState.portrait.texture) { releaseSprite(dialogState.portrait); dialogState.portrait.texture = NULL; }
     }
 }
 
 void dialog_close(void) {
-    if (dialogState.portrait_tex) { SDL_DestroyTexture(dialogState.portrait_tex); dialogState.portrait_tex = NULL; }
+    markSaveDirty(SAVE_DIALOG);
+    if (dialogState.portrait.texture) { releaseSprite(dialogState.portrait); dialogState.portrait.texture = NULL; }
     dialogState.active = false;
 }
 
@@ -336,15 +2090,13 @@ void dialog_draw(SDL_Renderer* renderer, TTF_Font* font) {
     const int boxPadding = 10;
     const int boxHeight = 140;
     SDL_Rect box = {20, 600 - boxHeight - 20, 800 - 40, boxHeight};
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
-    SDL_RenderFillRect(renderer, &box);
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    batchFillRect(&box, (SDL_Color){0, 0, 0, 180}, SDL_BLENDMODE_BLEND);
     SDL_Color textColor = {255, 255, 255, 255};
-    if (dialogState.portrait_visible && dialogState.portrait_tex) {
+    if (dialogState.portrait_visible && dialogState.portrait.texture) {
         SDL_Rect pRect = { box.x + 20, box.y - 100, 96, 96 };
-        SDL_RenderCopy(renderer, dialogState.portrait_tex, NULL, &pRect);
+        batchTexture(dialogState.portrait.texture, &dialogState.portrait.src, &pRect, SDL_FLIP_NONE);
     }
+    flushRenderBatch(renderer);
     if (dialogState.speaker_visible) renderText(renderer, font, dialogState.speaker, textColor, box.x + boxPadding, box.y + 6);
     if (dialogState.currentIndex < dialogState.totalLines) {
         int textTop = box.y + boxPadding + (dialogState.speaker_visible ? 26 : 0);
@@ -357,7 +2109,6 @@ void dialog_draw(SDL_Renderer* renderer, TTF_Font* font) {
 
 // Add to global variables
 bool isGambling = false;
-GamblingMachine gamblingMachine = {600, 430, NULL}; // Position the machine somewhere accessible
 bool aKeyPressed = false; // Track if A key was pressed last frame
 bool bKeyPressed = false; // Track if B key was pressed last frame
 bool escKeyPressed = false; // Track if ESC key was pressed last frame
@@ -374,14 +2125,18 @@ int currentBet = 0;  // Store the current bet amount
 bool showError = false;
 Uint32 errorStartTime = 0;
 
-Ray rayList[MAX_RAY] = {
-    {200, 430, NULL},  // First Ray
-    {800, 430, NULL},  // Second Ray
-    {1200, 430, NULL}  // Third Ray
-};
+int lastWinnings = 0;  // Payout of the most recent spin, shown with the result
 
 bool isShoppingOpen = false;
-Ray* currentRay = NULL;
+int currentRay = -1;  // Index of the Ray whose shop is open
+
+// What the player can interact with, refreshed once per tick by checkCollision()
+typedef struct {
+    int ray;        // Ray in range of A, or -1
+    int machine;    // Gambling machine in range, or -1
+} PlayerTriggers;
+
+PlayerTriggers playerTriggers = { -1, -1 };
 bool isPaused = false; // Pause state
 
 ShopItem shopItems[SHOP_ITEM_COUNT] = {
@@ -390,144 +2145,909 @@ ShopItem shopItems[SHOP_ITEM_COUNT] = {
     {"nuke", 1000, false}
 };
 
-Platform platforms[MAX_PLATFORMS] = {
-    {100, 500, {100, 500, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {300, 400, {300, 400, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {500, 300, {500, 300, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {200, 200, {200, 200, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {300, 500, {300, 500, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {400, 500, {400, 500, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {500, 500, {500, 500, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {500, 600, {500, 600, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {500, 700, {500, 700, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {600, 500, {600, 500, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {700, 500, {700, 500, PLATFORM_WIDTH, PLATFORM_HEIGHT}}, 
-    {400, 100, {400, 100, PLATFORM_WIDTH, PLATFORM_HEIGHT}}  
-};
+bool replayStateLocked = false; // A recording or replay owns the shop prices and player size; hot reloads leave them alone
 
-int platformCount = MAX_PLATFORMS;
+// Prices can be tuned from config: "## A pistol" then price=5
+static void applyShopConfig(void) {
+    if (replayStateLocked) {
+        printf("Shop prices stay as recorded until the recording or replay ends\n");
+        return;
+    }
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) {
+        long long price = getConfigInt(shopItems[i].name, "price", shopItems[i].price);
+        if (price >= 0 && price <= INT32_MAX) shopItems[i].price = (int)price;
+    }
+}
 
-// Piwo collectibles
-Piwo piwoList[MAX_PIWO] = {
-    {150, 450, NULL, false}, 
-    {350, 350, NULL, false}, 
-    {550, 250, NULL, false}, 
-    {250, 150, NULL, false}, 
-    {450, 50, NULL, false},  
-    {450, 51, NULL, false},  
-    {450, 52, NULL, false},  
-    {450, 53, NULL, false},  
-    {450, 54, NULL, false},  
-    {450, 55, NULL, false}   
-};
+/*
+ * Hot reload. Once the game is running, a watcher thread follows config/ and
+ * images/ with inotify (Linux; elsewhere this is a no-op). A changed image is
+ * re-decoded on that thread and a changed config.md is parsed into a fresh
+ * ConfigRegistry; results are queued and applyHotReloads() swaps them in
+ * between frames on the render thread. A same-size image is rewritten in
+ * place (inside its atlas page or standalone texture), so every Sprite copy
+ * stays valid; a new size gets its own texture and the HotSprite holders
+ * still pointing at the old one are moved over. After a config reload each
+ * holder is rebound to whatever its name now resolves to. A holder with a
+ * player takes the new sprite's size too, keeping the feet where they were.
+ * While watching,
+ * loose files win over the asset pack so edits show up without `make pack`.
+ */
+typedef struct {
+    const char* name;       // Config name the sprite was acquired with; read at reload time
+    const char* fallback;
+    Sprite* sprite;
+    Batarong* player;       // Collision box sized to the sprite, or NULL
+} HotSprite;
 
-int piwoCount = 0; // Counter for collected piwo
+typedef struct {
+    char path[CHARACTER_IMAGE_MAX];
+    SDL_Surface* surface;
+    MemoryFile pixels;      // Mapped pixel cache entry the surface may point into
+} HotImage;
+
+static SDL_Thread* hotReloadThread = NULL;
+static SDL_mutex* hotReloadMutex = NULL;
+static SDL_atomic_t hotReloadQuit;
+static HotImage hotImages[HOT_RELOAD_QUEUE];       // Decoded, waiting for the render thread
+static int hotImageCount = 0;
+static char hotRequests[HOT_RELOAD_QUEUE][CHARACTER_IMAGE_MAX]; // Paths the render thread wants decoded
+static int hotRequestCount = 0;
+static ConfigRegistry* hotConfig = NULL;            // Parsed, waiting for the render thread
+
+static void freeHotImage(HotImage* image) {
+    SDL_FreeSurface(image->surface);
+    releaseMemoryFile(&image->pixels);
+    image->surface = NULL;
+}
 
-// Add near other global variables
-SDL_Texture* gunTexture = NULL;
-bool hasGun = false;
+// Add path to a small list unless it's already there or the list is full
+static void addPathOnce(char paths[][CHARACTER_IMAGE_MAX], int* count, const char* path) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(paths[i], path) == 0) return;
+    }
+    if (*count < HOT_RELOAD_QUEUE) snprintf(paths[(*count)++], CHARACTER_IMAGE_MAX, "%s", path);
+}
 
-// Add to global variables
-Bullet bullets[MAX_BULLETS] = {0};
-Uint32 lastShotTime = 0;
-const int SHOOT_COOLDOWN = 250;  // 250ms cooldown between shots
-// Maintain a compact list of active bullet indices to avoid scanning all slots
-static int activeBulletIndices[MAX_BULLETS];
-static int activeBulletCount = 0;
+// Ask the watcher to decode path (render thread)
+static void requestHotImage(const char* path) {
+    if (!hotReloadThread) return;
+    SDL_LockMutex(hotReloadMutex);
+    addPathOnce(hotRequests, &hotRequestCount, path);
+    SDL_UnlockMutex(hotReloadMutex);
+}
 
-// Function prototypes
-void handleInput(bool* running, Batarong* batarong, bool* gameOver);
-void applyGravity(Batarong* batarong);
-bool checkCollision(Batarong* batarong, bool* gameOver);
-void renderPlatforms(SDL_Renderer* renderer);
-void renderGameOver(SDL_Renderer* renderer, TTF_Font* font);
-void renderText(SDL_Renderer* renderer, TTF_Font* font, const char* text, SDL_Color color, int x, int y);
-void renderPiwo(SDL_Renderer* renderer);
-void renderSprintBar(SDL_Renderer* renderer, float sprintEnergy, Batarong* batarong, TTF_Font* font);
-void renderGamblingScreen(SDL_Renderer* renderer, TTF_Font* font, TTF_Font* smallFont);
-bool isNearGamblingMachine(Batarong* batarong);
-void handleTextInput(SDL_Event* event);
-void startGambling();
-bool hasEnoughPiwoToPlay(void);
-bool isNearRay(Batarong* batarong, Ray* ray);
-void renderShopScreen(SDL_Renderer* renderer, TTF_Font* font);
+#ifdef HAVE_INOTIFY
+static int hotReloadFd = -1;
+static int configWatch = -1;
+static int imagesWatch = -1;
+
+// Watcher: collect changed files, then parse or decode them here, off the render thread
+static int hotReloadWorker(void* data) {
+    (void)data;
+    TRACE_THREAD("hot-reload");
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (!SDL_AtomicGet(&hotReloadQuit)) {
+        char changed[HOT_RELOAD_QUEUE][CHARACTER_IMAGE_MAX];
+        int changedCount = 0;
+        bool configChanged = false;
+        struct pollfd watch = { hotReloadFd, POLLIN, 0 };
+        if (poll(&watch, 1, HOT_RELOAD_POLL_MS) > 0) {
+            SDL_Delay(HOT_RELOAD_SETTLE_MS);
+            ssize_t length;
+            while ((length = read(hotReloadFd, buffer, sizeof(buffer))) > 0) {
+                for (char* cursor = buffer; cursor < buffer + length;) {
+                    const struct inotify_event* event = (const struct inotify_event*)cursor;
+                    cursor += sizeof(struct inotify_event) + event->len;
+                    if (event->len == 0) continue;
+                    if (event->wd == configWatch && strcmp(event->name, "config.md") == 0) configChanged = true;
+                    size_t nameLength = strlen(event->name);
+                    bool bitmap = nameLength > 4 && strcmp(event->name + nameLength - 4, ".bmp") == 0;
+                    if (event->wd == imagesWatch && bitmap && event->name[0] != '.') {
+                        char path[CHARACTER_IMAGE_MAX];
+                        int written = snprintf(path, sizeof(path), IMAGES_DIR "/%.*s", CHARACTER_IMAGE_MAX, event->name);
+                        if (written > 0 && written < (int)sizeof(path)) addPathOnce(changed, &changedCount, path);
+                    }
+                }
+            }
+        }
+        SDL_LockMutex(hotReloadMutex);
+        for (int i = 0; i < hotRequestCount; i++) addPathOnce(changed, &changedCount, hotRequests[i]);
+        hotRequestCount = 0;
+        SDL_UnlockMutex(hotReloadMutex);
+
+        if (configChanged) {
+            ConfigRegistry* registry = calloc(1, sizeof(ConfigRegistry));
+            MemoryFile file;
+            if (registry && loadAsset(CONFIG_PATH, &file) == 0) {
+                parseConfig(registry, file.data, file.size);
+                releaseMemoryFile(&file);
+                SDL_LockMutex(hotReloadMutex);
+                if (hotConfig) {
+                    freeConfigRegistry(hotConfig); // Superseded before the render thread took it
+                    free(hotConfig);
+                }
+                hotConfig = registry;
+                SDL_UnlockMutex(hotReloadMutex);
+            } else {
+                free(registry);
+            }
+        }
+        for (int i = 0; i < changedCount; i++) {
+            HotImage image;
+            memset(&image, 0, sizeof(image));
+            memcpy(image.path, changed[i], sizeof(image.path));
+            TRACE_BEGIN_ARG("decodeImage", image.path);
+            image.surface = decodeImage(image.path, &image.pixels);
+            TRACE_END("decodeImage");
+            if (!image.surface) continue; // Half-written or not a BMP: the next write retries
+            SDL_LockMutex(hotReloadMutex);
+            if (hotImageCount < HOT_RELOAD_QUEUE) hotImages[hotImageCount++] = image;
+            else freeHotImage(&image);
+            SDL_UnlockMutex(hotReloadMutex);
+        }
+    }
+    return 0;
+}
+#endif
 
-// New pause screen renderer
-void renderPauseScreen(SDL_Renderer* renderer, TTF_Font* font);
+static void startHotReload(void) {
+#ifdef HAVE_INOTIFY
+    hotReloadFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hotReloadFd < 0) {
+        printf("Hot reload unavailable: inotify_init1 failed\n");
+        return;
+    }
+    // Watch directories, not files: editors often save by renaming a new file over the old one
+    configWatch = inotify_add_watch(hotReloadFd, CONFIG_DIR, IN_CLOSE_WRITE | IN_MOVED_TO);
+    imagesWatch = inotify_add_watch(hotReloadFd, IMAGES_DIR, IN_CLOSE_WRITE | IN_MOVED_TO);
+    hotReloadMutex = SDL_CreateMutex();
+    if ((configWatch < 0 && imagesWatch < 0) || !hotReloadMutex) {
+        printf("Hot reload unavailable: nothing to watch\n");
+        close(hotReloadFd);
+        hotReloadFd = -1;
+        if (hotReloadMutex) SDL_DestroyMutex(hotReloadMutex);
+        hotReloadMutex = NULL;
+        return;
+    }
+    looseFilesFirst = true;
+    SDL_AtomicSet(&hotReloadQuit, 0);
+    hotReloadThread = SDL_CreateThread(hotReloadWorker, "hot-reload", NULL);
+    if (!hotReloadThread) printf("Hot reload thread unavailable: %s\n", SDL_GetError());
+#endif
+}
 
-// Add these new function prototypes after existing ones
-void shootBullet(Batarong* batarong);
-void updateBullets(void);
-void renderBullets(SDL_Renderer* renderer);
-// Dialog system prototypes (scaffold)
-void dialog_start_simple(const char** lines, int lineCount);
-void dialog_start(const char** lines, int lineCount, const char* speakerName, const char* portraitKey, bool freeze_movement, bool portrait_visible, bool speaker_visible, SDL_Renderer* renderer);
-void dialog_next(void);
-void dialog_close(void);
-void dialog_draw(SDL_Renderer* renderer, TTF_Font* font);
+static void stopHotReload(void) {
+    if (hotReloadThread) {
+        SDL_AtomicSet(&hotReloadQuit, 1);
+        SDL_WaitThread(hotReloadThread, NULL);
+        hotReloadThread = NULL;
+    }
+#ifdef HAVE_INOTIFY
+    if (hotReloadFd >= 0) close(hotReloadFd);
+    hotReloadFd = configWatch = imagesWatch = -1;
+#endif
+    for (int i = 0; i < hotImageCount; i++) freeHotImage(&hotImages[i]);
+    hotImageCount = hotRequestCount = 0;
+    if (hotConfig) {
+        freeConfigRegistry(hotConfig);
+        free(hotConfig);
+        hotConfig = NULL;
+    }
+    if (hotReloadMutex) SDL_DestroyMutex(hotReloadMutex);
+    hotReloadMutex = NULL;
+}
 
-bool isNearGamblingMachine(Batarong* batarong) {
-    int dx = abs((batarong->x + batarong->width/2) - (gamblingMachine.x + GAMBLING_MACHINE_WIDTH/2));
-    int dy = abs((batarong->y + batarong->height/2) - (gamblingMachine.y + GAMBLING_MACHINE_HEIGHT/2));
-    return dx < 50 && dy < 50; // Within 50 pixels of the machine
+// Swap a re-decoded image into its cache entry (or add it if a holder now wants it)
+static void swapHotImage(SDL_Renderer* renderer, const HotImage* image, const HotSprite* holders, int holderCount) {
+    SDL_Surface* surface = image->surface;
+    TextureCacheEntry* entry = findCachedTexture(image->path);
+    if (!entry) {
+        for (int i = 0; i < holderCount; i++) {
+            if (!holders[i].name || !holders[i].sprite->texture) continue;
+            const char* path = getCharacterImage(holders[i].name, holders[i].fallback);
+            if (!path || strcmp(path, image->path) != 0) continue;
+            Sprite sprite = { createStaticTexture(renderer, surface), { 0, 0, surface->w, surface->h } };
+            if (sprite.texture && !addCachedTexture(image->path, sprite, true)) SDL_DestroyTexture(sprite.texture);
+            return;
+        }
+        return; // Not in use; it will be decoded if something asks for it
+    }
+    Sprite old = entry->sprite;
+    if (surface->w == old.src.w && surface->h == old.src.h &&
+        SDL_UpdateTexture(old.texture, &old.src, surface->pixels, surface->pitch) == 0) {
+        printf("Reloaded %s\n", image->path);
+        return;
+    }
+    Sprite sprite = { createStaticTexture(renderer, surface), { 0, 0, surface->w, surface->h } };
+    if (!sprite.texture) return;
+    for (int i = 0; i < holderCount; i++) {
+        if (sameSprite(*holders[i].sprite, old)) *holders[i].sprite = sprite;
+    }
+    if (entry->ownsTexture) SDL_DestroyTexture(old.texture);
+    entry->sprite = sprite;
+    entry->ownsTexture = true;
+    printf("Reloaded %s (%dx%d)\n", image->path, surface->w, surface->h);
 }
 
-bool hasEnoughPiwoToPlay(void) {
-    return piwoCount >= 10;
+/*
+ * Render thread, between frames (before anything is batched): take finished
+ * work from the watcher and swap it in. holders are every long-lived Sprite
+ * the game draws with, so size changes and config edits can retarget them.
+ */
+static void applyHotReloads(SDL_Renderer* renderer, const HotSprite* holders, int holderCount) {
+    if (!hotReloadThread) return;
+    HotImage images[HOT_RELOAD_QUEUE];
+    SDL_LockMutex(hotReloadMutex);
+    int imageCount = hotImageCount;
+    memcpy(images, hotImages, (size_t)imageCount * sizeof(HotImage));
+    hotImageCount = 0;
+    ConfigRegistry* reloaded = hotConfig;
+    hotConfig = NULL;
+    SDL_UnlockMutex(hotReloadMutex);
+    if (imageCount == 0 && !reloaded) return;
+
+    if (reloaded) {
+        // Nothing keeps pointers into the old registry across frames, so it can go now
+        freeConfigRegistry(&configRegistry);
+        configRegistry = *reloaded;
+        free(reloaded);
+        applyShopConfig();
+        printf("Reloaded %s\n", CONFIG_PATH);
+    }
+    for (int i = 0; i < imageCount; i++) {
+        swapHotImage(renderer, &images[i], holders, holderCount);
+        freeHotImage(&images[i]);
+    }
+    // Rebind holders whose name now resolves to a different image
+    for (int i = 0; i < holderCount; i++) {
+        if (!holders[i].name || !*holders[i].name || !holders[i].sprite->texture) continue;
+        const char* path = getCharacterImage(holders[i].name, holders[i].fallback);
+        const TextureCacheEntry* current = findSpriteEntry(*holders[i].sprite);
+        if (!path || (current && strcmp(current->path, path) == 0)) continue;
+        if (!findCachedTexture(path)) {
+            requestHotImage(path); // Decoded off-thread; this loop picks it up when it lands
+            continue;
+        }
+        Sprite sprite = acquireSprite(renderer, holders[i].name, holders[i].fallback);
+        if (!sprite.texture) continue;
+        releaseSprite(*holders[i].sprite);
+        *holders[i].sprite = sprite;
+    }
+    // A resized player image resizes the player, or collision would keep the old box
+    for (int i = 0; i < holderCount; i++) {
+        Batarong* player = holders[i].player;
+        const SDL_Rect* src = &holders[i].sprite->src;
+        if (!player || !holders[i].sprite->texture || (src->w == player->width && src->h == player->height)) continue;
+        if (replayStateLocked) {
+            printf("Player size stays as recorded until the recording or replay ends\n");
+            continue;
+        }
+        float rise = (float)(src->h - player->height);
+        player->y -= rise;
+        player->prevY -= rise;
+        player->width = src->w;
+        player->height = src->h;
+        printf("Player resized to %dx%d\n", player->width, player->height);
+    }
+    staticLayerGeneration++;  // Baked tiles may show the old pixels
 }
 
-bool isNearRay(Batarong* batarong, Ray* ray) {
-    int dx = abs((batarong->x + batarong->width/2) - (ray->x + RAY_WIDTH/2));
-    int dy = abs((batarong->y + batarong->height/2) - (ray->y + RAY_HEIGHT/2));
-    return dx < 50 && dy < 50;
+/*
+ * Level data. Positions are read in place from the level image (an mmap'd
+ * levels/<world>.lvl file, or a generated buffer in the same format); only the
+ * per-run piwo collected flags live in writable memory.
+ */
+static MemoryFile levelFile = {0};
+static Uint64 levelHash = 0;        // Of levelFile's bytes, computed on first use by levelFileHash()
+static bool levelHashValid = false;
+
+const Sint32* platformX = NULL;
+const Sint32* platformY = NULL;
+int platformCount = 0;
+
+// Piwo collectibles
+const Sint32* piwoX = NULL;
+const Sint32* piwoY = NULL;
+bool* piwoCollected = NULL;
+int piwoListCount = 0;
+Sprite piwoSprite = {0};
+
+// Ray NPCs (shopkeepers)
+const Sint32* rayX = NULL;
+const Sint32* rayY = NULL;
+int rayCount = 0;
+Sprite raySprite = {0};
+
+// Gambling machines
+const Sint32* machineX = NULL;
+const Sint32* machineY = NULL;
+int machineCount = 0;
+Sprite gamblingMachineSprite = {0};
+
+/*
+ * Uniform grid over the level bounds. Items are bucketed by every cell their
+ * box overlaps and stored contiguously per cell (cellStart[c]..cellStart[c+1]),
+ * so a query only walks the cells a box touches. Built once per level load.
+ */
+typedef struct {
+    int originX, originY;   // World position of cell (0, 0)
+    int cols, rows;
+    int* cellStart;         // cols * rows + 1 offsets into items
+    int* items;             // Entity indices grouped by cell
+} SpatialGrid;
+
+static void freeSpatialGrid(SpatialGrid* grid) {
+    free(grid->cellStart);
+    free(grid->items);
+    memset(grid, 0, sizeof(*grid));
 }
 
-void renderGamblingScreen(SDL_Renderer* renderer, TTF_Font* font, TTF_Font* smallFont) {
-    // Fill screen with a different color for gambling screen
-    SDL_SetRenderDrawColor(renderer, 50, 0, 100, 255);
-    SDL_RenderClear(renderer);
+static int floorDiv(int a, int b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
 
-    // Render title at the top
-    SDL_Color textColor = {255, 255, 255};
-    renderText(renderer, font, "Gambling Screen (Press B to exit)", textColor, 250, 50);
+// Clamp a world box to the grid's cell range; returns false if it misses the grid entirely
+static bool gridCellRange(const SpatialGrid* grid, int minX, int minY, int maxX, int maxY,
+                          int* c0, int* r0, int* c1, int* r1) {
+    if (grid->cols == 0) return false;
+    *c0 = floorDiv(minX - grid->originX, GRID_CELL_SIZE);
+    *r0 = floorDiv(minY - grid->originY, GRID_CELL_SIZE);
+    *c1 = floorDiv(maxX - grid->originX, GRID_CELL_SIZE);
+    *r1 = floorDiv(maxY - grid->originY, GRID_CELL_SIZE);
+    if (*c1 < 0 || *r1 < 0 || *c0 >= grid->cols || *r0 >= grid->rows) return false;
+    if (*c0 < 0) *c0 = 0;
+    if (*r0 < 0) *r0 = 0;
+    if (*c1 >= grid->cols) *c1 = grid->cols - 1;
+    if (*r1 >= grid->rows) *r1 = grid->rows - 1;
+    return true;
+}
 
-    // Show current piwo count
-    char piwoText[32];
-    sprintf(piwoText, "Current Piwo: %d", piwoCount);
-    renderText(renderer, font, piwoText, textColor, 250, 100);
+// boxes[i] is stored as entity indexBase + i
+static bool buildSpatialGrid(SpatialGrid* grid, const SDL_Rect* boxes, int count, int indexBase) {
+    freeSpatialGrid(grid);
+    if (count <= 0) return true;
+    int minX = boxes[0].x, minY = boxes[0].y;
+    int maxX = boxes[0].x + boxes[0].w, maxY = boxes[0].y + boxes[0].h;
+    for (int i = 1; i < count; i++) {
+        if (boxes[i].x < minX) minX = boxes[i].x;
+        if (boxes[i].y < minY) minY = boxes[i].y;
+        if (boxes[i].x + boxes[i].w > maxX) maxX = boxes[i].x + boxes[i].w;
+        if (boxes[i].y + boxes[i].h > maxY) maxY = boxes[i].y + boxes[i].h;
+    }
+    grid->originX = minX;
+    grid->originY = minY;
+    grid->cols = (maxX - minX) / GRID_CELL_SIZE + 1;
+    grid->rows = (maxY - minY) / GRID_CELL_SIZE + 1;
+    size_t cellCount = (size_t)grid->cols * (size_t)grid->rows;
+    grid->cellStart = calloc(cellCount + 1, sizeof(int));
+    if (!grid->cellStart) { freeSpatialGrid(grid); return false; }
+
+    // Pass 1: count entries per cell
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        int c0, r0, c1, r1;
+        gridCellRange(grid, boxes[i].x, boxes[i].y, boxes[i].x + boxes[i].w, boxes[i].y + boxes[i].h, &c0, &r0, &c1, &r1);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++) { grid->cellStart[r * grid->cols + c + 1]++; total++; }
+    }
+    for (size_t c = 0; c < cellCount; c++) grid->cellStart[c + 1] += grid->cellStart[c];
+
+    // Pass 2: scatter indices (ascending per cell, since i increases)
+    grid->items = malloc(sizeof(int) * (size_t)total);
+    int* fill = malloc(sizeof(int) * cellCount);
+    if (!grid->items || !fill) { free(fill); freeSpatialGrid(grid); return false; }
+    memcpy(fill, grid->cellStart, sizeof(int) * cellCount);
+    for (int i = 0; i < count; i++) {
+        int c0, r0, c1, r1;
+        gridCellRange(grid, boxes[i].x, boxes[i].y, boxes[i].x + boxes[i].w, boxes[i].y + boxes[i].h, &c0, &r0, &c1, &r1);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++) grid->items[fill[r * grid->cols + c]++] = indexBase + i;
+    }
+    free(fill);
+    return true;
+}
 
-    if (isSpinning) {
-        Uint32 currentTime = SDL_GetTicks();
-        if (currentTime - spinStartTime >= SPIN_TIME) {
-            isSpinning = false;
-            spinResult = (rand() % 4) + 1;  // Random number between 1-4
-            resultStartTime = currentTime;
-            resultDisplayed = true;
+/*
+ * Batch overlap tests. overlapMask() checks a run of entity positions against
+ * one query and sets bit i of the mask when entity i is inside it. Queries are
+ * open bounds on an entity's top-left corner, which turns a box-vs-box test
+ * into four integer compares per entity; boxQuery() builds one from a float
+ * box so results match comparing the boxes directly. The kernel is picked once:
+ * AVX2 when the CPU has it, SSE2 on other x86 builds, otherwise scalar.
+ */
+typedef struct {
+    Sint32 minX, maxX;      // Entity x must satisfy minX < x < maxX
+    Sint32 minY, maxY;
+} OverlapQuery;
+
+typedef void (*OverlapKernel)(const Sint32* xs, const Sint32* ys, int count, const OverlapQuery* q, Uint32* mask);
+
+// Query for entities of size entityW x entityH that overlap the box
+static OverlapQuery boxQuery(float x, float y, float w, float h, int entityW, int entityH) {
+    return (OverlapQuery){
+        (Sint32)floorf(x) - entityW, (Sint32)ceilf(x + w),
+        (Sint32)floorf(y) - entityH, (Sint32)ceilf(y + h)
+    };
+}
+
+// Entities [start, count); also finishes the vector kernels' tails
+static void overlapMaskFrom(const Sint32* xs, const Sint32* ys, int start, int count, const OverlapQuery* q, Uint32* mask) {
+    for (int i = start; i < count; i++) {
+        if (xs[i] > q->minX && xs[i] < q->maxX && ys[i] > q->minY && ys[i] < q->maxY) mask[i >> 5] |= 1u << (i & 31);
+    }
+}
+
+static void overlapMaskScalar(const Sint32* xs, const Sint32* ys, int count, const OverlapQuery* q, Uint32* mask) {
+    overlapMaskFrom(xs, ys, 0, count, q, mask);
+}
+
+#ifdef HAVE_SSE2
+static void overlapMaskSSE2(const Sint32* xs, const Sint32* ys, int count, const OverlapQuery* q, Uint32* mask) {
+    const __m128i minX = _mm_set1_epi32(q->minX), maxX = _mm_set1_epi32(q->maxX);
+    const __m128i minY = _mm_set1_epi32(q->minY), maxY = _mm_set1_epi32(q->maxY);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(xs + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(ys + i));
+        __m128i inside = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(x, minX), _mm_cmpgt_epi32(maxX, x)),
+                                       _mm_and_si128(_mm_cmpgt_epi32(y, minY), _mm_cmpgt_epi32(maxY, y)));
+        mask[i >> 5] |= (Uint32)_mm_movemask_ps(_mm_castsi128_ps(inside)) << (i & 31);
+    }
+    overlapMaskFrom(xs, ys, i, count, q, mask);
+}
+#endif
+
+#ifdef HAVE_AVX2_TARGET
+__attribute__((target("avx2")))
+static void overlapMaskAVX2(const Sint32* xs, const Sint32* ys, int count, const OverlapQuery* q, Uint32* mask) {
+    const __m256i minX = _mm256_set1_epi32(q->minX), maxX = _mm256_set1_epi32(q->maxX);
+    const __m256i minY = _mm256_set1_epi32(q->minY), maxY = _mm256_set1_epi32(q->maxY);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(xs + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(ys + i));
+        __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(x, minX), _mm256_cmpgt_epi32(maxX, x)),
+                                          _mm256_and_si256(_mm256_cmpgt_epi32(y, minY), _mm256_cmpgt_epi32(maxY, y)));
+        mask[i >> 5] |= (Uint32)_mm256_movemask_ps(_mm256_castsi256_ps(inside)) << (i & 31);
+    }
+    // GCC emits no vzeroupper for target("avx2") functions; dirty upper halves slow every SSE instruction after
+    _mm256_zeroupper();
+    overlapMaskFrom(xs, ys, i, count, q, mask);
+}
+#endif
+
+static OverlapKernel overlapKernel = NULL;
+static const char* overlapKernelName = "scalar";
+
+static void chooseOverlapKernel(void) {
+    overlapKernel = overlapMaskScalar;
+#ifdef HAVE_SSE2
+    overlapKernel = overlapMaskSSE2;
+    overlapKernelName = "sse2";
+#endif
+#ifdef HAVE_AVX2_TARGET
+    if (__builtin_cpu_supports("avx2")) {
+        overlapKernel = overlapMaskAVX2;
+        overlapKernelName = "avx2";
+    }
+#endif
+}
+
+// Set bit i of mask[] for each of the first count (<= OVERLAP_BATCH) entities inside q
+static void overlapMask(const Sint32* xs, const Sint32* ys, int count, const OverlapQuery* q, Uint32 mask[OVERLAP_BATCH / 32]) {
+    if (!overlapKernel) chooseOverlapKernel();
+    memset(mask, 0, sizeof(Uint32) * (OVERLAP_BATCH / 32));
+    overlapKernel(xs, ys, count, q, mask);
+}
+
+/*
+ * World streaming. The level is split into fixed-width chunks (see
+ * level_format.h) and only chunks around the camera keep collision grids and
+ * have their pages of the level file resident. A worker thread prefetches the
+ * next chunk in the direction the player faces; the simulation loads a chunk
+ * inline if it gets there first, so results never depend on thread timing.
+ */
+enum { CHUNK_UNLOADED, CHUNK_LOADING, CHUNK_RESIDENT };
+
+typedef struct {
+    SDL_atomic_t state;     // CHUNK_*; grids are only read while RESIDENT
+    SpatialGrid platformGrid;
+} WorldChunk;
+
+static const LevelHeader* levelHeader = NULL;
+static const Uint32* chunkTable = NULL;    // (chunkCount + 1) rows of LEVEL_ARRAY_COUNT start indices
+static WorldChunk* worldChunks = NULL;
+static int worldChunkCount = 0;
+static int residentChunks[STREAM_MAX_RESIDENT_CHUNKS]; // LOADING or RESIDENT chunks, main thread only
+static int residentChunkCount = 0;
+
+static SDL_Thread* streamThread = NULL;
+static SDL_mutex* streamMutex = NULL;
+static SDL_cond* streamCond = NULL;        // Signals new requests and finished chunks
+static int streamRequest = -1;             // Chunk queued for the worker, -1 when idle
+static bool streamQuit = false;
+
+// First index of kind in chunk; chunk == worldChunkCount gives the column's count
+static int chunkStart(int chunk, int kind) {
+    return (int)chunkTable[chunk * LEVEL_ARRAY_COUNT + kind];
+}
+
+// Chunks that can hold an entity overlapping world span [minX, maxX]
+static bool chunkSpan(int minX, int maxX, int* first, int* last) {
+    if (worldChunkCount == 0) return false;
+    *first = (int)levelChunkIndex(levelHeader, (Sint64)minX - STREAM_ENTITY_MAX_WIDTH);
+    *last = (int)levelChunkIndex(levelHeader, maxX);
+    return true;
+}
+
+// Call visit(index, user) for every entity of a kind in chunks [first, last] inside q, lowest index first.
+// Columns are x-sorted, so only the run with minX < x < maxX goes through the kernel.
+static void forEachOverlap(const Sint32* xs, const Sint32* ys, int kind, int first, int last, const OverlapQuery* q,
+                           bool (*visit)(int index, void* user), void* user) {
+    int lo = chunkStart(first, kind), hi = chunkStart(last + 1, kind);
+    int a = lo, b = hi;
+    while (a < b) { int mid = a + (b - a) / 2; if (xs[mid] <= q->minX) a = mid + 1; else b = mid; }
+    lo = a;
+    b = hi;
+    while (a < b) { int mid = a + (b - a) / 2; if (xs[mid] < q->maxX) a = mid + 1; else b = mid; }
+    hi = a;
+    Uint32 mask[OVERLAP_BATCH / 32];
+    for (int base = lo; base < hi; base += OVERLAP_BATCH) {
+        int count = hi - base < OVERLAP_BATCH ? hi - base : OVERLAP_BATCH;
+        overlapMask(xs + base, ys + base, count, q, mask);
+        for (int w = 0; w < (count + 31) / 32; w++) {
+            for (Uint32 bits = mask[w]; bits; bits &= bits - 1) {
+                if (!visit(base + w * 32 + __builtin_ctz(bits), user)) return;
+            }
+        }
+    }
+}
+
+static bool chunkResident(int chunk) {
+    return SDL_AtomicGet(&worldChunks[chunk].state) == CHUNK_RESIDENT;
+}
+
+// Hint the kernel about a chunk's slice of every column (mapped level files only)
+static void adviseChunkPages(int chunk, int advice) {
+#ifdef HAVE_MMAP
+    if (!levelFile.mapped) return;
+    const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    for (int k = 0; k < LEVEL_ARRAY_COUNT; k++) {
+        int first = chunkStart(chunk, k), end = chunkStart(chunk + 1, k);
+        const Uint32 offsets[2] = { levelHeader->arrays[k].xOffset, levelHeader->arrays[k].yOffset };
+        for (int axis = 0; axis < 2 && first < end; axis++) {
+            uintptr_t column = (uintptr_t)levelFile.data + offsets[axis];
+            uintptr_t start = column + (uintptr_t)first * sizeof(Sint32);
+            uintptr_t stop = column + (uintptr_t)end * sizeof(Sint32);
+            // Read-ahead may round outwards; dropping only touches pages wholly inside the chunk
+            if (advice == MADV_WILLNEED) start &= ~(pageSize - 1);
+            else start = (start + pageSize - 1) & ~(pageSize - 1);
+            stop &= ~(pageSize - 1);
+            if (stop > start) madvise((void*)start, stop - start, advice);
+        }
+    }
+#else
+    (void)chunk; (void)advice;
+#endif
+}
+
+// Page in a chunk and build its collision grids (grid items are global entity indices)
+static void loadChunk(int chunk) {
+    WorldChunk* wc = &worldChunks[chunk];
+#ifdef HAVE_MMAP
+    adviseChunkPages(chunk, MADV_WILLNEED);
+#endif
+    int firstPlatform = chunkStart(chunk, LEVEL_PLATFORMS), platforms = chunkStart(chunk + 1, LEVEL_PLATFORMS) - firstPlatform;
+    SDL_Rect* boxes = malloc(sizeof(SDL_Rect) * (size_t)(platforms > 0 ? platforms : 1));
+    if (!boxes) {
+        printf("Out of memory building collision grids for chunk %d\n", chunk);
+        return;
+    }
+    for (int i = 0; i < platforms; i++)
+        boxes[i] = (SDL_Rect){ platformX[firstPlatform + i], platformY[firstPlatform + i], PLATFORM_WIDTH, PLATFORM_HEIGHT };
+    buildSpatialGrid(&wc->platformGrid, boxes, platforms, firstPlatform);
+    free(boxes);
+}
+
+static void releaseChunk(int chunk) {
+    WorldChunk* wc = &worldChunks[chunk];
+    freeSpatialGrid(&wc->platformGrid);
+#ifdef HAVE_MMAP
+    adviseChunkPages(chunk, MADV_DONTNEED);
+#endif
+    SDL_AtomicSet(&wc->state, CHUNK_UNLOADED);
+}
+
+// Add a chunk to the resident list, evicting the farthest resident chunk if it is full
+static bool trackResidentChunk(int chunk) {
+    if (residentChunkCount == STREAM_MAX_RESIDENT_CHUNKS) {
+        int victim = -1;
+        for (int i = 0; i < residentChunkCount; i++) {
+            if (!chunkResident(residentChunks[i])) continue;
+            if (victim < 0 || abs(residentChunks[i] - chunk) > abs(residentChunks[victim] - chunk)) victim = i;
+        }
+        if (victim < 0) return false;
+        releaseChunk(residentChunks[victim]);
+        residentChunks[victim] = residentChunks[--residentChunkCount];
+    }
+    residentChunks[residentChunkCount++] = chunk;
+    return true;
+}
+
+static int streamWorker(void* data) {
+    (void)data;
+    TRACE_THREAD("world-stream");
+    SDL_LockMutex(streamMutex);
+    while (!streamQuit) {
+        if (streamRequest < 0) {
+            SDL_CondWait(streamCond, streamMutex);
+            continue;
+        }
+        int chunk = streamRequest;
+        streamRequest = -1;
+        SDL_UnlockMutex(streamMutex);
+        TRACE("loadChunk", loadChunk(chunk));
+        SDL_LockMutex(streamMutex);
+        SDL_AtomicSet(&worldChunks[chunk].state, CHUNK_RESIDENT);
+        SDL_CondBroadcast(streamCond);
+    }
+    SDL_UnlockMutex(streamMutex);
+    return 0;
+}
+
+// Make a chunk resident before the simulation reads its grids. Returns NULL only
+// if the resident list is full of chunks still loading.
+static const WorldChunk* acquireChunk(int chunk) {
+    WorldChunk* wc = &worldChunks[chunk];
+    int state = SDL_AtomicGet(&wc->state);
+    if (state == CHUNK_RESIDENT) return wc;
+    if (state == CHUNK_LOADING) {
+        // Prefetch in flight: wait for it rather than building the chunk twice
+        SDL_LockMutex(streamMutex);
+        while (!chunkResident(chunk)) SDL_CondWait(streamCond, streamMutex);
+        SDL_UnlockMutex(streamMutex);
+        return wc;
+    }
+    if (!trackResidentChunk(chunk)) return NULL;
+    TRACE("loadChunk", loadChunk(chunk));
+    SDL_AtomicSet(&wc->state, CHUNK_RESIDENT);
+    return wc;
+}
+
+// Once per tick: drop chunks that left the view, make the visible ones resident
+// and queue the next chunk ahead of the player for the worker
+static void updateWorldStreaming(int viewLeft, bool facingLeft) {
+    int first, last;
+    if (!chunkSpan(viewLeft, viewLeft + STREAM_VIEW_WIDTH, &first, &last)) return;
+    for (int i = 0; i < residentChunkCount; ) {
+        int chunk = residentChunks[i];
+        if ((chunk < first - STREAM_KEEP_CHUNKS || chunk > last + STREAM_KEEP_CHUNKS) && chunkResident(chunk)) {
+            releaseChunk(chunk);
+            residentChunks[i] = residentChunks[--residentChunkCount];
         } else {
-            renderText(renderer, font, "Spinning...", textColor, 350, 250);
+            i++;
+        }
+    }
+    for (int chunk = first; chunk <= last; chunk++) acquireChunk(chunk);
+
+    int ahead = facingLeft ? first - 1 : last + 1;
+    if (!streamThread || ahead < 0 || ahead >= worldChunkCount ||
+        SDL_AtomicGet(&worldChunks[ahead].state) != CHUNK_UNLOADED) return;
+    SDL_LockMutex(streamMutex);
+    if (streamRequest < 0 && residentChunkCount < STREAM_MAX_RESIDENT_CHUNKS) {
+        residentChunks[residentChunkCount++] = ahead;
+        SDL_AtomicSet(&worldChunks[ahead].state, CHUNK_LOADING);
+        streamRequest = ahead;
+        SDL_CondBroadcast(streamCond);
+    }
+    SDL_UnlockMutex(streamMutex);
+}
+
+static void stopWorldStreaming(void) {
+    if (streamThread) {
+        SDL_LockMutex(streamMutex);
+        streamQuit = true;
+        SDL_CondBroadcast(streamCond);
+        SDL_UnlockMutex(streamMutex);
+        SDL_WaitThread(streamThread, NULL);
+        streamThread = NULL;
+    }
+    if (streamCond) SDL_DestroyCond(streamCond);
+    if (streamMutex) SDL_DestroyMutex(streamMutex);
+    streamCond = NULL;
+    streamMutex = NULL;
+    for (int c = 0; c < worldChunkCount; c++) {
+        freeSpatialGrid(&worldChunks[c].platformGrid);
+    }
+    free(worldChunks);
+    worldChunks = NULL;
+    worldChunkCount = residentChunkCount = 0;
+    streamRequest = -1;
+    streamQuit = false;
+}
+
+static bool startWorldStreaming(void) {
+    worldChunks = calloc(levelHeader->chunkCount, sizeof(WorldChunk));
+    if (!worldChunks) return false;
+    worldChunkCount = (int)levelHeader->chunkCount;
+    streamMutex = SDL_CreateMutex();
+    streamCond = SDL_CreateCond();
+    if (streamMutex && streamCond) streamThread = SDL_CreateThread(streamWorker, "world-stream", NULL);
+    if (!streamThread) printf("World streaming thread unavailable, loading chunks inline: %s\n", SDL_GetError());
+    return true;
+}
+
+static void unloadLevel(void) {
+    stopWorldStreaming();
+    free(piwoCollected);
+    piwoCollected = NULL;
+    releaseMemoryFile(&levelFile);
+    levelHeader = NULL;
+    chunkTable = NULL;
+    platformX = platformY = piwoX = piwoY = rayX = rayY = machineX = machineY = NULL;
+    platformCount = piwoListCount = rayCount = machineCount = 0;
+}
+
+// Validate a level image and point the entity columns into it. Takes ownership of file.
+static bool bindLevel(MemoryFile* file) {
+    const LevelHeader* header = (const LevelHeader*)file->data;
+    bool valid = file->size >= sizeof(LevelHeader) &&
+                 memcmp(header->magic, LEVEL_MAGIC, 4) == 0 &&
+                 header->endianTag == LEVEL_ENDIAN_TAG &&
+                 header->fileSize == file->size;
+    if (valid && header->version != LEVEL_VERSION) {
+        printf("Level version %u is not supported (expected %d)\n", header->version, LEVEL_VERSION);
+        valid = false;
+    }
+    for (int i = 0; valid && i < LEVEL_ARRAY_COUNT; i++) {
+        const LevelArray* array = &header->arrays[i];
+        Uint64 bytes = (Uint64)array->count * sizeof(Sint32);
+        valid = array->count <= INT32_MAX &&
+                array->xOffset % sizeof(Sint32) == 0 && array->yOffset % sizeof(Sint32) == 0 &&
+                array->xOffset + bytes <= file->size && array->yOffset + bytes <= file->size;
+    }
+    if (valid) {
+        Uint64 tableBytes = ((Uint64)header->chunkCount + 1) * LEVEL_ARRAY_COUNT * sizeof(Uint32);
+        valid = header->chunkWidth > 0 && header->chunkCount > 0 && header->chunkCount <= LEVEL_MAX_CHUNKS &&
+                header->chunkOffset % sizeof(Uint32) == 0 && header->chunkOffset + tableBytes <= file->size;
+    }
+    if (valid) {
+        // Chunk ranges must be ordered and cover each column exactly
+        const Uint32* table = (const Uint32*)((const unsigned char*)file->data + header->chunkOffset);
+        for (int k = 0; valid && k < LEVEL_ARRAY_COUNT; k++) {
+            valid = table[k] == 0 && table[header->chunkCount * LEVEL_ARRAY_COUNT + k] == header->arrays[k].count;
+            for (Uint32 c = 0; valid && c < header->chunkCount; c++)
+                valid = table[c * LEVEL_ARRAY_COUNT + k] <= table[(c + 1) * LEVEL_ARRAY_COUNT + k];
         }
+    }
+    if (!valid) {
+        printf("Invalid level data\n");
+        releaseMemoryFile(file);
+        return false;
+    }
+
+    unloadLevel();
+    levelFile = *file;
+    levelHashValid = false;
+    staticLayerGeneration++;
+    memset(file, 0, sizeof(*file));
+    const unsigned char* base = (const unsigned char*)levelFile.data;
+    levelHeader = (const LevelHeader*)base;
+    chunkTable = (const Uint32*)(base + levelHeader->chunkOffset);
+    const LevelArray* arrays = levelHeader->arrays;
+    platformX = (const Sint32*)(base + arrays[LEVEL_PLATFORMS].xOffset);
+    platformY = (const Sint32*)(base + arrays[LEVEL_PLATFORMS].yOffset);
+    platformCount = (int)arrays[LEVEL_PLATFORMS].count;
+    piwoX = (const Sint32*)(base + arrays[LEVEL_PIWO].xOffset);
+    piwoY = (const Sint32*)(base + arrays[LEVEL_PIWO].yOffset);
+    piwoListCount = (int)arrays[LEVEL_PIWO].count;
+    rayX = (const Sint32*)(base + arrays[LEVEL_RAYS].xOffset);
+    rayY = (const Sint32*)(base + arrays[LEVEL_RAYS].yOffset);
+    rayCount = (int)arrays[LEVEL_RAYS].count;
+    machineX = (const Sint32*)(base + arrays[LEVEL_MACHINES].xOffset);
+    machineY = (const Sint32*)(base + arrays[LEVEL_MACHINES].yOffset);
+    machineCount = (int)arrays[LEVEL_MACHINES].count;
+    piwoCollected = calloc((size_t)(piwoListCount > 0 ? piwoListCount : 1), sizeof(bool));
+    markSaveDirty(SAVE_PIWO);
+    if (!piwoCollected || !startWorldStreaming()) {
+        printf("Out of memory loading level\n");
+        unloadLevel();
+        return false;
+    }
+    return true;
+}
+
+static bool loadLevel(const char* path) {
+    MemoryFile file = {0};
+    if (mapFileToMemory(path, &file) != 0) {
+        printf("Unable to load level: %s\n", path);
+        return false;
+    }
+    return bindLevel(&file);
+}
+
+int piwoCount = 0; // Counter for collected piwo
+
+// Add near other global variables
+Sprite gunSprite = {0};
+bool hasGun = false;
+
+// Add to global variables
+static EntityStore bulletStore = {0};  // Live bullets are rows [0, bulletStore.count)
+Uint32 lastShotTime = 0;
+const int SHOOT_COOLDOWN = 250;  // 250ms cooldown between shots
+
+// Function prototypes
+void pollEvents(bool* running);
+void readKeyboardInput(InputState* input);
+void handleInput(Batarong* batarong, bool* gameOver, const InputState* input);
+void updateGambling(void);
+void applyGravity(Batarong* batarong);
+bool checkCollision(Batarong* batarong, bool* gameOver);
+void renderPlatforms(SDL_Renderer* renderer);
+void renderGameOver(SDL_Renderer* renderer, TTF_Font* font);
+void renderText(SDL_Renderer* renderer, TTF_Font* font, const char* text, SDL_Color color, int x, int y);
+void renderPiwo(SDL_Renderer* renderer);
+void renderMachines(SDL_Renderer* renderer);
+void renderRays(SDL_Renderer* renderer);
+void renderPlayer(SDL_Renderer* renderer, const Batarong* batarong, int playerX, int playerY);
+void renderSprintBar(SDL_Renderer* renderer, float sprintEnergy, Batarong* batarong, TTF_Font* font);
+void renderGamblingScreen(SDL_Renderer* renderer, TTF_Font* font, TTF_Font* smallFont);
+void handleTextInput(SDL_Event* event);
+void startGambling();
+bool hasEnoughPiwoToPlay(void);
+void renderShopScreen(SDL_Renderer* renderer, TTF_Font* font);
+
+// New pause screen renderer
+void renderPauseScreen(SDL_Renderer* renderer, TTF_Font* font);
+
+// Add these new function prototypes after existing ones
+void shootBullet(Batarong* batarong);
+void updateBullets(void);
+void renderBullets(SDL_Renderer* renderer, float alpha);
+#ifdef PROFILER
+static void profileHandleEvent(const SDL_Event* event);
+#endif
+// Dialog system prototypes (scaffold)
+void dialog_start_simple(const char** lines, int lineCount);
+void dialog_start(const char** lines, int lineCount, const char* speakerName, const char* portraitKey, bool freeze_movement, bool portrait_visible, bool speaker_visible, SDL_Renderer* renderer);
+void dialog_next(void);
+void dialog_close(void);
+void dialog_draw(SDL_Renderer* renderer, TTF_Font* font);
+
+bool hasEnoughPiwoToPlay(void) {
+    return piwoCount >= 10;
+}
+
+void renderGamblingScreen(SDL_Renderer* renderer, TTF_Font* font, TTF_Font* smallFont) {
+    // Fill screen with a different color for gambling screen
+    SDL_SetRenderDrawColor(renderer, 50, 0, 100, 255);
+    SDL_RenderClear(renderer);
+
+    // Render title at the top
+    SDL_Color textColor = {255, 255, 255};
+    renderText(renderer, font, "Gambling Screen (Press B to exit)", textColor, 250, 50);
+
+    // Show current piwo count
+    char piwoText[32];
+    sprintf(piwoText, "Current Piwo: %d", piwoCount);
+    renderText(renderer, font, piwoText, textColor, 250, 100);
+
+    // Spin resolution and payout happen in updateGambling; this only displays state
+    if (isSpinning) {
+        renderText(renderer, font, "Spinning...", textColor, 350, 250);
     } else if (resultDisplayed) {
         char resultText[64];
         
         if (spinResult == 1) {
-            int winnings = currentBet * 2;
-            piwoCount += winnings;
-            sprintf(resultText, "You won! 2x! Bet: %d, Won: %d", currentBet, winnings);
+            sprintf(resultText, "You won! 2x! Bet: %d, Won: %d", currentBet, lastWinnings);
         } else if (spinResult == 2) {
-            // Fix: Use floating-point arithmetic for accurate calculation
-            int winnings = (int)(currentBet * 1.25f + 0.5f);  // Multiply by 1.25 and round
-            piwoCount += winnings;
-            sprintf(resultText, "You won! 1.25x! Bet: %d, Won: %d", currentBet, winnings);
+            sprintf(resultText, "You won! 1.25x! Bet: %d, Won: %d", currentBet, lastWinnings);
         } else {
             sprintf(resultText, "You lost! Bet: %d", currentBet);
         }
         renderText(renderer, font, resultText, textColor, 250, 250);
-
-        // Clear result after display time
-        if (SDL_GetTicks() - resultStartTime >= RESULT_DISPLAY_TIME) {
-            resultDisplayed = false;
-            currentBet = 0;  // Reset the stored bet amount
-        }
     } else {
         // Render text input box background near bottom left
         SDL_SetRenderDrawColor(renderer, 70, 70, 70, 255);
@@ -541,10 +3061,6 @@ void renderGamblingScreen(SDL_Renderer* renderer, TTF_Font* font, TTF_Font* smal
         } else if (showError) {
             SDL_Color errorColor = {255, 0, 0};  // Red color for error
             renderText(renderer, font, "Not enough piwo!", errorColor, 250, 300);
-            
-            if (SDL_GetTicks() - errorStartTime >= ERROR_DISPLAY_TIME) {
-                showError = false;
-            }
         }
 
         // Render input text or placeholder in new position
@@ -576,14 +3092,15 @@ void renderShopScreen(SDL_Renderer* renderer, TTF_Font* font) {
     sprintf(piwoText, "Your Piwo: %d", piwoCount);
     renderText(renderer, font, piwoText, textColor, 250, 100);
 
-    // Render shop items
+    // Item backgrounds, submitted together before the text on top of them
     for (int i = 0; i < SHOP_ITEM_COUNT; i++) {
         SDL_Rect itemRect = {200, 150 + (i * 80), 400, 60};
+        batchFillRect(&itemRect, (SDL_Color){50, 50, 50, 255}, SDL_BLENDMODE_NONE);
+    }
+    flushRenderBatch(renderer);
 
-        // Item background
-        SDL_SetRenderDrawColor(renderer, 50, 50, 50, 255);
-        SDL_RenderFillRect(renderer, &itemRect);
-
+    // Render shop items
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) {
         // Item text
         char itemText[256];
         const int maxNameLen = 80; // Hard cap to avoid overly long lines
@@ -598,40 +3115,48 @@ void renderShopScreen(SDL_Renderer* renderer, TTF_Font* font) {
     }
 }
 
-// Modify handleTextInput function to properly handle numeric input
+// Bet keys typed between ticks; readKeyboardInput() hands them to the next InputState
+static char pendingKeys[INPUT_KEY_MAX];
+static int pendingKeyCount = 0;
+
+// Queue numeric input and backspace for the bet field; the edit itself happens on the tick
 void handleTextInput(SDL_Event* event) {
-    if (event->type == SDL_KEYDOWN) {
+    if (event->type == SDL_KEYDOWN && pendingKeyCount < INPUT_KEY_MAX) {
         // Handle backspace
-        if (event->key.keysym.sym == SDLK_BACKSPACE && betInput.length > 0) {
-            betInput.text[--betInput.length] = '\0';
+        if (event->key.keysym.sym == SDLK_BACKSPACE) {
+            pendingKeys[pendingKeyCount++] = '\b';
         }
         // Handle number keys (both numeric keypad and regular numbers)
-        else if ((event->key.keysym.sym >= SDLK_0 && event->key.keysym.sym <= SDLK_9) ||
-                 (event->key.keysym.sym >= SDLK_KP_0 && event->key.keysym.sym <= SDLK_KP_9)) {
-            if (betInput.length < betInput.maxLength) {
-                char numChar;
-                if (event->key.keysym.sym >= SDLK_KP_0) {
-                    numChar = '0' + (event->key.keysym.sym - SDLK_KP_0);
-                } else {
-                    numChar = '0' + (event->key.keysym.sym - SDLK_0);
-                }
-                betInput.text[betInput.length++] = numChar;
-                betInput.text[betInput.length] = '\0';
-            }
+        else if (event->key.keysym.sym >= SDLK_KP_0 && event->key.keysym.sym <= SDLK_KP_9) {
+            pendingKeys[pendingKeyCount++] = (char)('0' + (event->key.keysym.sym - SDLK_KP_0));
+        } else if (event->key.keysym.sym >= SDLK_0 && event->key.keysym.sym <= SDLK_9) {
+            pendingKeys[pendingKeyCount++] = (char)('0' + (event->key.keysym.sym - SDLK_0));
         }
     }
 }
 
+// Apply one typed bet key to the bet field
+static void applyBetKey(char key) {
+    markSaveDirty(SAVE_GAMBLING);
+    if (key == '\b') {
+        if (betInput.length > 0) betInput.text[--betInput.length] = '\0';
+    } else if (betInput.length < betInput.maxLength) {
+        betInput.text[betInput.length++] = key;
+        betInput.text[betInput.length] = '\0';
+    }
+}
+
 void startGambling() {
     if (!hasEnoughPiwoToPlay()) {
         return;  // Don't allow gambling if not enough piwo
     }
     if (betInput.length > 0) {
+        markSaveDirty(SAVE_GAMBLING);
         currentBet = atoi(betInput.text);  // Store the bet amount
         if (currentBet >= 10) {  // Check minimum bet first
             if (currentBet <= piwoCount) {
                 isSpinning = true;
-                spinStartTime = SDL_GetTicks();
+                spinStartTime = simTimeMs();
                 piwoCount -= currentBet;  // Deduct the bet amount
                 betInput.length = 0;  // Clear input
                 betInput.text[0] = '\0';
@@ -639,30 +3164,111 @@ void startGambling() {
             } else {
                 // Show error for insufficient piwo
                 showError = true;
-                errorStartTime = SDL_GetTicks();
+                errorStartTime = simTimeMs();
+            }
+        }
+    }
+}
+
+// Resolve spins, pay out and expire timed messages; runs on the simulation tick
+void updateGambling(void) {
+    Uint32 currentTime = simTimeMs();
+    if (isSpinning) {
+        if (currentTime - spinStartTime >= SPIN_TIME) {
+            markSaveDirty(SAVE_GAMBLING);
+            isSpinning = false;
+            spinResult = (int)(simRandom() % 4) + 1;  // Random number between 1-4
+            if (spinResult == 1) {
+                lastWinnings = currentBet * 2;
+            } else if (spinResult == 2) {
+                // Use floating-point arithmetic for accurate calculation
+                lastWinnings = (int)(currentBet * 1.25f + 0.5f);  // Multiply by 1.25 and round
+            } else {
+                lastWinnings = 0;
             }
+            piwoCount += lastWinnings;  // Paid once, when the spin resolves
+            resultStartTime = currentTime;
+            resultDisplayed = true;
+        }
+    } else if (resultDisplayed) {
+        // Clear result after display time
+        if (currentTime - resultStartTime >= RESULT_DISPLAY_TIME) {
+            markSaveDirty(SAVE_GAMBLING);
+            resultDisplayed = false;
+            currentBet = 0;  // Reset the stored bet amount
         }
     }
+    if (showError && currentTime - errorStartTime >= ERROR_DISPLAY_TIME) {
+        markSaveDirty(SAVE_GAMBLING);
+        showError = false;
+    }
+}
+
+// Sample the keyboard into an InputState (one fetch per tick)
+void readKeyboardInput(InputState* input) {
+    const Uint8* state = SDL_GetKeyboardState(NULL);
+    Uint16 buttons = 0;
+    if (state[SDL_SCANCODE_LEFT]) buttons |= INPUT_LEFT;
+    if (state[SDL_SCANCODE_RIGHT]) buttons |= INPUT_RIGHT;
+    if (state[SDL_SCANCODE_UP]) buttons |= INPUT_UP;
+    if (state[SDL_SCANCODE_LSHIFT]) buttons |= INPUT_SPRINT;
+    if (state[SDL_SCANCODE_A]) buttons |= INPUT_A;
+    if (state[SDL_SCANCODE_B]) buttons |= INPUT_B;
+    if (state[SDL_SCANCODE_ESCAPE]) buttons |= INPUT_ESC;
+    if (state[SDL_SCANCODE_SPACE]) buttons |= INPUT_SHOOT;
+    if (state[SDL_SCANCODE_R]) buttons |= INPUT_RESTART;
+    if (state[SDL_SCANCODE_1]) buttons |= INPUT_SHOP_1;
+    if (state[SDL_SCANCODE_2]) buttons |= INPUT_SHOP_2;
+    if (state[SDL_SCANCODE_3]) buttons |= INPUT_SHOP_3;
+    if (state[SDL_SCANCODE_Z]) buttons |= INPUT_REWIND;
+    input->buttons = buttons;
+    input->keyCount = (Uint8)pendingKeyCount;
+    memcpy(input->keys, pendingKeys, (size_t)pendingKeyCount);
+    pendingKeyCount = 0;
 }
 
-// Only call SDL_GetKeyboardState once per frame
-void handleInput(bool* running, Batarong* batarong, bool* gameOver) {
+// Save state keys, acted on by the main loop between ticks
+static bool saveStateRequested = false;
+static bool loadStateRequested = false;
+
+// Drain the SDL event queue once per rendered frame
+void pollEvents(bool* running) {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         if (event.type == SDL_QUIT) {
             *running = false; // Exit the loop if the window is closed
         }
+        if (event.type == SDL_RENDER_TARGETS_RESET) {
+            staticLayerGeneration++;  // Render target contents were lost
+        }
+        if (event.type == SDL_KEYDOWN && !event.key.repeat) {
+            if (event.key.keysym.sym == SDLK_F5) saveStateRequested = true;
+            if (event.key.keysym.sym == SDLK_F9) loadStateRequested = true;
+        }
         if (isGambling) {
             handleTextInput(&event);
         }
+#ifdef PROFILER
+        profileHandleEvent(&event);
+#endif
+    }
+}
+
+// Runs once per simulation tick against a pre-sampled InputState
+void handleInput(Batarong* batarong, bool* gameOver, const InputState* input) {
+    const Uint16 held = input->buttons;
+
+    batarong->velocityX = 0;
+
+    // Bet keys typed since the last tick go in before A is read, so type-then-confirm works in one frame
+    if (isGambling) {
+        for (int i = 0; i < input->keyCount; i++) applyBetKey(input->keys[i]);
     }
-    // Get the current state of the keyboard (single fetch)
-    const Uint8* state = SDL_GetKeyboardState(NULL);
 
     // Handle keyboard input for movement
     if (!*gameOver) {
         // ESC handling (single press)
-        if (state[SDL_SCANCODE_ESCAPE]) {
+        if (held & INPUT_ESC) {
             if (!escKeyPressed) {
                 if (isGambling) {
                     isGambling = false;
@@ -672,28 +3278,27 @@ void handleInput(bool* running, Batarong* batarong, bool* gameOver) {
                     isPaused = !isPaused; // Toggle pause
                 }
                 escKeyPressed = true;
+                markSaveDirty(SAVE_GAMBLING);
             }
-        } else {
+        } else if (escKeyPressed) {
             escKeyPressed = false;
+            markSaveDirty(SAVE_GAMBLING);
         }
 
         // When paused, ignore rest of gameplay input (except ESC already handled)
         if (isPaused) return;
 
         // Add gambling interaction with key press check
-        if (state[SDL_SCANCODE_A]) {
+        if (held & INPUT_A) {
             if (!aKeyPressed) {  // Only trigger once when key is first pressed
                 if (!isGambling && !isShoppingOpen) {
-                    // Check all Ray NPCs
-                    for (int i = 0; i < MAX_RAY; i++) {
-                        if (isNearRay(batarong, &rayList[i])) {
-                            isShoppingOpen = true;
-                            currentRay = &rayList[i];
-                            break;
-                        }
+                    // Check nearby Ray NPCs
+                    if (playerTriggers.ray >= 0) {
+                        isShoppingOpen = true;
+                        currentRay = playerTriggers.ray;
                     }
                     if (!isShoppingOpen) {  // If not near Ray, check gambling machine
-                        if (isNearGamblingMachine(batarong)) {
+                        if (playerTriggers.machine >= 0) {
                             isGambling = true;
                         }
                     }
@@ -701,333 +3306,2625 @@ void handleInput(bool* running, Batarong* batarong, bool* gameOver) {
                     startGambling();  // Start gambling when A is pressed again
                 }
                 aKeyPressed = true;
+                markSaveDirty(SAVE_GAMBLING);
             }
-        } else {
+        } else if (aKeyPressed) {
             aKeyPressed = false;  // Reset when key is released
+            markSaveDirty(SAVE_GAMBLING);
         }
 
         // Add B key for exiting gambling menu
-        if (state[SDL_SCANCODE_B]) {
+        if (held & INPUT_B) {
             if (!bKeyPressed) {  // Only trigger once when key is first pressed
                 if (isShoppingOpen) {
                     isShoppingOpen = false;
-                    currentRay = NULL;
+                    currentRay = -1;
                 } else if (isGambling) {
                     isGambling = false;
                 }
                 bKeyPressed = true;
+                markSaveDirty(SAVE_GAMBLING);
             }
-        } else {
+        } else if (bKeyPressed) {
             bKeyPressed = false;  // Reset when key is released
+            markSaveDirty(SAVE_GAMBLING);
         }
 
     if (!isGambling) {
             // Check if sprint key was released
-            if (!state[SDL_SCANCODE_LSHIFT]) {
+            if (!(held & INPUT_SPRINT)) {
                 batarong->sprintKeyReleased = true;
                 batarong->isSprinting = false;  // Stop sprinting when key is released
                 // Only regenerate sprint when shift is not held
-                batarong->sprintEnergy = fminf(batarong->sprintEnergy + SPRINT_REGEN_RATE, MAX_SPRINT_ENERGY);
+                batarong->sprintEnergy = fminf(batarong->sprintEnergy + SPRINT_REGEN_RATE * SIM_TICK_SCALE, MAX_SPRINT_ENERGY);
             }
 
             // Only allow sprinting if we have energy and key was released after depleting energy
             if (batarong->sprintEnergy <= 0) {
                 batarong->isSprinting = false;
-            } else if (state[SDL_SCANCODE_LSHIFT] && batarong->sprintKeyReleased) {
+            } else if ((held & INPUT_SPRINT) && batarong->sprintKeyReleased) {
                 batarong->isSprinting = true;
                 batarong->sprintKeyReleased = false;
             }
             
             // Handle sprint energy drain
-            if (batarong->isSprinting && (state[SDL_SCANCODE_LEFT] || state[SDL_SCANCODE_RIGHT])) {
-                batarong->sprintEnergy = fmaxf(batarong->sprintEnergy - SPRINT_DRAIN_RATE, 0);
+            if (batarong->isSprinting && ((held & INPUT_LEFT) || (held & INPUT_RIGHT))) {
+                batarong->sprintEnergy = fmaxf(batarong->sprintEnergy - SPRINT_DRAIN_RATE * SIM_TICK_SCALE, 0);
+            }
+
+            float currentSpeed = BASE_SPEED * (batarong->isSprinting ? SPRINT_SPEED : 1.0) * SIM_TICK_SCALE;
+
+            // Block movement when dialog requests freeze
+            if (!dialogState.active || !dialogState.freeze_movement) {
+                if (held & INPUT_UP) {
+                    if (batarong->onGround) {
+                        batarong->velocityY = JUMP_FORCE * SIM_TICK_SCALE; // Jump if on the ground
+                        batarong->onGround = false;
+                    }
+                }
+                if (held & INPUT_LEFT) {
+                    batarong->velocityX -= currentSpeed; // Move left (checkCollision applies it)
+                    batarong->facingLeft = true;  // Update direction
+                }
+                if (held & INPUT_RIGHT) {
+                    batarong->velocityX += currentSpeed; // Move right
+                    batarong->facingLeft = false;  // Update direction
+                }
+            }
+        }
+
+        // Add number key handling for shop purchases
+        if (isShoppingOpen) {
+            if ((held & INPUT_SHOP_1) || (held & INPUT_SHOP_2) || (held & INPUT_SHOP_3)) {
+                int itemIndex = -1;
+                if (held & INPUT_SHOP_1) itemIndex = 0;
+                if (held & INPUT_SHOP_2) itemIndex = 1;
+                if (held & INPUT_SHOP_3) itemIndex = 2;
+
+                if (itemIndex >= 0 && !shopItems[itemIndex].purchased) {
+                    if (piwoCount >= shopItems[itemIndex].price) {
+                        piwoCount -= shopItems[itemIndex].price;
+                        shopItems[itemIndex].purchased = true;
+                        // Give player the gun when purchasing first item (pistol)
+                        if (itemIndex == 0) {
+                            hasGun = true;
+                        }
+                    }
+                }
+            }
+        }
+
+    } else {
+        // Update the restart logic in handleInput function
+        if (held & INPUT_RESTART) {
+            *gameOver = false; // Reset game over state
+            batarong->x = batarong->prevX = 300; // Reset player position (no interpolation across the reset)
+            batarong->y = batarong->prevY = 400; // Reset player position
+            batarong->velocityY = 0; // Reset vertical velocity
+            batarong->onGround = true; // Reset on ground status
+            batarong->sprintEnergy = MAX_SPRINT_ENERGY;  // Reset sprint energy to full
+            batarong->isSprinting = false;  // Reset sprint state
+            batarong->sprintKeyReleased = true;  // Reset sprint key state
+            // Remove piwo reset
+            // piwoCount = 0; // Remove this line
+            // Remove piwo collectibles reset
+            for (int i = 0; i < piwoListCount; i++) {
+                if (!piwoCollected[i]) {
+                    piwoCollected[i] = false; // Only reset uncollected piwo
+                }
             }
+            // Don't reset gun status
+            // hasGun = false; // Remove this line if it exists
+        }
+    }
+
+    // Shooting control (reuses fetched state)
+    if (!*gameOver && !isGambling && !isShoppingOpen && !isPaused) {
+        if ((held & INPUT_SHOOT) && hasGun) {
+            shootBullet(batarong);
+        }
+    }
+}
 
-            float currentSpeed = BASE_SPEED * (batarong->isSprinting ? SPRINT_SPEED : 1.0);
+void applyGravity(Batarong* batarong) {
+    // Acceleration scales with the square of the tick length; checkCollision() does the moving
+    batarong->velocityY = fminf(batarong->velocityY + GRAVITY * SIM_TICK_SCALE * SIM_TICK_SCALE,
+                                TERMINAL_VELOCITY * SIM_TICK_SCALE);
+}
+
+/*
+ * Swept AABB. Platforms are one-way, as they always were: the player walks and
+ * jumps through them and only lands on top. While falling, the player's box is
+ * swept by (dx, dy) against every platform in the grid cells its path covers;
+ * the earliest time of impact wins (lowest index on ties, so results don't
+ * depend on cell order) and the player lands on that platform's top. A box
+ * that already overlaps a platform when it starts to fall (the spawn point, the
+ * top of a jump through a platform) lands on it straight away.
+ */
+typedef struct {
+    float time;     // Fraction of the step at first contact, in [0, 1)
+    int platform;   // -1 if the step is clear
+} SweepHit;
+
+// Entry and exit times of [a, a + size) moving by d through [b, b + other); false if they never overlap
+static bool sweepAxis(float a, float size, float d, float b, float other, float* entry, float* exit) {
+    if (d > 0.0f) {
+        *entry = (b - (a + size)) / d;
+        *exit = (b + other - a) / d;
+    } else if (d < 0.0f) {
+        *entry = (b + other - a) / d;
+        *exit = (b - (a + size)) / d;
+    } else if (a < b + other && a + size > b) {
+        *entry = -INFINITY;
+        *exit = INFINITY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void sweepPlatformGrid(const SpatialGrid* grid, const Batarong* batarong, float dx, float dy, SweepHit* hit) {
+    int c0, r0, c1, r1;
+    if (!gridCellRange(grid, (int)floorf(fminf(batarong->x, batarong->x + dx)), (int)floorf(fminf(batarong->y, batarong->y + dy)),
+                       (int)ceilf(fmaxf(batarong->x, batarong->x + dx)) + batarong->width,
+                       (int)ceilf(fmaxf(batarong->y, batarong->y + dy)) + batarong->height,
+                       &c0, &r0, &c1, &r1)) return;
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            int cell = r * grid->cols + c;
+            for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+                int i = grid->items[k];
+                float entryX, exitX, entryY, exitY;
+                if (!sweepAxis(batarong->x, (float)batarong->width, dx, (float)platformX[i], PLATFORM_WIDTH, &entryX, &exitX) ||
+                    !sweepAxis(batarong->y, (float)batarong->height, dy, (float)platformY[i], PLATFORM_HEIGHT, &entryY, &exitY)) continue;
+                float entry = fmaxf(entryX, entryY);
+                float exit = fminf(exitX, exitY);
+                if (entry >= exit || exit <= 0.0f || entry >= 1.0f) continue;
+                entry = fmaxf(entry, 0.0f);         // Already overlapping: land now
+                if (hit->platform >= 0 && (entry > hit->time || (entry == hit->time && i > hit->platform))) continue;
+                hit->time = entry;
+                hit->platform = i;
+            }
+        }
+    }
+}
+
+// Move the player by its velocity for one tick, landing on the first platform top it falls onto
+static void moveBatarong(Batarong* batarong) {
+    float dx = batarong->velocityX, dy = batarong->velocityY;
+    batarong->onGround = false;
+    SweepHit hit = { 1.0f, -1 };
+    int first, last;
+    // Rising or level, nothing stops the player
+    if (dy > 0.0f && chunkSpan((int)floorf(fminf(batarong->x, batarong->x + dx)),
+                               (int)ceilf(fmaxf(batarong->x, batarong->x + dx)) + batarong->width, &first, &last)) {
+        for (int chunk = first; chunk <= last; chunk++) {
+            const WorldChunk* wc = acquireChunk(chunk);
+            if (wc) sweepPlatformGrid(&wc->platformGrid, batarong, dx, dy, &hit);
+        }
+    }
+    batarong->x += dx;  // No walls: the player walks on for the whole tick
+    if (hit.platform < 0) {
+        batarong->y += dy;
+        return;
+    }
+    batarong->y = (float)(platformY[hit.platform] - batarong->height);
+    batarong->onGround = true;
+    batarong->velocityY = 0;
+}
+
+static bool collectPiwoVisit(int i, void* user) {
+    (void)user;
+    if (!piwoCollected[i]) {
+        piwoCollected[i] = true; // Mark piwo as collected
+        markSaveDirty(SAVE_PIWO);
+        piwoCount++; // Increment the piwo counter
+    }
+    return true;
+}
+
+static bool firstOverlapVisit(int i, void* user) {
+    *(int*)user = i;
+    return false;
+}
+
+// Entities whose centre is within TRIGGER_RANGE of the player's on both axes
+static OverlapQuery triggerQuery(const Batarong* batarong, int entityW, int entityH) {
+    int x = (int)batarong->x + batarong->width / 2 - entityW / 2;
+    int y = (int)batarong->y + batarong->height / 2 - entityH / 2;
+    return (OverlapQuery){ x - TRIGGER_RANGE, x + TRIGGER_RANGE, y - TRIGGER_RANGE, y + TRIGGER_RANGE };
+}
+
+// One pass over everything around the player: collects the piwo under its box (if collect)
+// and records the Ray and gambling machine in range for input and prompts
+static void scanPlayerOverlaps(const Batarong* batarong, bool collect) {
+    OverlapQuery piwo = boxQuery(batarong->x, batarong->y, (float)batarong->width, (float)batarong->height, PIWO_SIZE, PIWO_SIZE);
+    OverlapQuery ray = triggerQuery(batarong, RAY_WIDTH, RAY_HEIGHT);
+    OverlapQuery machine = triggerQuery(batarong, GAMBLING_MACHINE_WIDTH, GAMBLING_MACHINE_HEIGHT);
+    playerTriggers.ray = playerTriggers.machine = -1;
+    int minX = piwo.minX < ray.minX ? piwo.minX : ray.minX;
+    int maxX = piwo.maxX > ray.maxX ? piwo.maxX : ray.maxX;
+    if (machine.minX < minX) minX = machine.minX;
+    if (machine.maxX > maxX) maxX = machine.maxX;
+    int first, last;
+    if (!chunkSpan(minX, maxX, &first, &last)) return;
+    if (collect) forEachOverlap(piwoX, piwoY, LEVEL_PIWO, first, last, &piwo, collectPiwoVisit, NULL);
+    forEachOverlap(rayX, rayY, LEVEL_RAYS, first, last, &ray, firstOverlapVisit, &playerTriggers.ray);
+    forEachOverlap(machineX, machineY, LEVEL_MACHINES, first, last, &machine, firstOverlapVisit, &playerTriggers.machine);
+}
+
+bool checkCollision(Batarong* batarong, bool* gameOver) {
+    // Apply this tick's movement with swept collision against the platforms
+    moveBatarong(batarong);
+
+    // Check if the player has fallen below the bottom of the window
+    if (batarong->y > WINDOW_HEIGHT) {
+        *gameOver = true; // Set game over state
+    }
+
+    // Piwo under the player's box, and what's in range for A and the prompts
+    scanPlayerOverlaps(batarong, true);
+
+    return batarong->onGround;
+}
+
+/*
+ * Visibility culling. cullWorld() runs once per frame: everything in the
+ * resident chunks under the camera, plus active bullets, is tested against the
+ * camera rectangle and the survivors' indices are kept per kind. World-space
+ * renderers draw only from these lists, so draw calls scale with the screen
+ * rather than the level.
+ */
+enum { VISIBLE_BULLETS = LEVEL_ARRAY_COUNT, VISIBLE_KIND_COUNT };
+
+typedef struct {
+    int* indices;
+    int count;
+    int capacity;
+} VisibleList;
+
+typedef struct {
+    int drawn;      // Entities submitted this frame
+    int culled;     // Entities skipped (off screen, in unloaded chunks or collected)
+} CullStats;
+
+static VisibleList visibleLists[VISIBLE_KIND_COUNT];
+CullStats cullStats = {0};  // Last frame's totals, for the profiler
+
+static void pushVisible(VisibleList* list, int index) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        int* indices = realloc(list->indices, sizeof(int) * (size_t)capacity);
+        if (!indices) return; // Drop the draw rather than the frame
+        list->indices = indices;
+        list->capacity = capacity;
+    }
+    list->indices[list->count++] = index;
+}
+
+static void freeVisibleLists(void) {
+    for (int k = 0; k < VISIBLE_KIND_COUNT; k++) free(visibleLists[k].indices);
+    memset(visibleLists, 0, sizeof(visibleLists));
+}
+
+static bool boxInView(const SDL_Rect* view, int x, int y, int w, int h) {
+    return x < view->x + view->w && x + w > view->x && y < view->y + view->h && y + h > view->y;
+}
+
+// Cull one kind of level entity within a chunk; hidden may flag entities not to draw
+static void cullChunkColumn(const SDL_Rect* view, int chunk, int kind, const Sint32* xs, const Sint32* ys,
+                            int w, int h, const bool* hidden) {
+    VisibleList* list = &visibleLists[kind];
+    for (int i = chunkStart(chunk, kind); i < chunkStart(chunk + 1, kind); i++) {
+        if ((!hidden || !hidden[i]) && boxInView(view, xs[i], ys[i], w, h)) pushVisible(list, i);
+    }
+}
+
+// Build this frame's visible lists for the camera rectangle (world coordinates).
+// Platforms, machines and Ray are skipped unless cullStatic (the static layer draws them).
+static void cullWorld(const SDL_Rect* view, float alpha, bool cullStatic) {
+    for (int k = 0; k < VISIBLE_KIND_COUNT; k++) visibleLists[k].count = 0;
+    int first, last;
+    if (chunkSpan(view->x, view->x + view->w, &first, &last)) {
+        for (int chunk = first; chunk <= last; chunk++) {
+            if (!chunkResident(chunk)) continue;
+            cullChunkColumn(view, chunk, LEVEL_PIWO, piwoX, piwoY, PIWO_SIZE, PIWO_SIZE, piwoCollected);
+            if (!cullStatic) continue;
+            cullChunkColumn(view, chunk, LEVEL_PLATFORMS, platformX, platformY, PLATFORM_WIDTH, PLATFORM_HEIGHT, NULL);
+            cullChunkColumn(view, chunk, LEVEL_RAYS, rayX, rayY, RAY_WIDTH, RAY_HEIGHT, NULL);
+            cullChunkColumn(view, chunk, LEVEL_MACHINES, machineX, machineY, GAMBLING_MACHINE_WIDTH, GAMBLING_MACHINE_HEIGHT, NULL);
+        }
+    }
+    const EntityStore* bullets = &bulletStore;
+    for (int i = 0; i < bullets->count; i++) {
+        float x = bullets->prevX[i] + (bullets->x[i] - bullets->prevX[i]) * alpha;
+        if (boxInView(view, (int)x, (int)bullets->y[i], (int)bullets->w[i], (int)bullets->h[i])) pushVisible(&visibleLists[VISIBLE_BULLETS], i);
+    }
+
+    int total = piwoListCount + bullets->count;
+    if (cullStatic) total += platformCount + rayCount + machineCount;
+    cullStats.drawn = 0;
+    for (int k = 0; k < VISIBLE_KIND_COUNT; k++) cullStats.drawn += visibleLists[k].count;
+    cullStats.culled = total - cullStats.drawn;
+}
+
+static const SDL_Color platformColor = {0, 255, 0, 255}; // Green color for platforms
+
+// World renderers queue into the render batch; main() flushes once the layer is done
+void renderPlatforms(SDL_Renderer* renderer) {
+    (void)renderer;
+    const VisibleList* visible = &visibleLists[LEVEL_PLATFORMS];
+    for (int n = 0; n < visible->count; n++) {
+        int i = visible->indices[n];
+        // Adjust platform position based on camera
+        SDL_Rect platformRect = { platformX[i] - cameraX, platformY[i], PLATFORM_WIDTH, PLATFORM_HEIGHT };
+        batchFillRect(&platformRect, platformColor, SDL_BLENDMODE_NONE);
+    }
+}
+
+void renderPiwo(SDL_Renderer* renderer) {
+    (void)renderer;
+    const VisibleList* visible = &visibleLists[LEVEL_PIWO];
+    for (int n = 0; n < visible->count; n++) {
+        int i = visible->indices[n];
+        SDL_Rect piwoRect = { piwoX[i] - cameraX, piwoY[i], PIWO_SIZE, PIWO_SIZE }; // Adjust position based on camera
+        batchTexture(piwoSprite.texture, &piwoSprite.src, &piwoRect, SDL_FLIP_NONE); // Draw the piwo sprite
+    }
+}
+
+void renderMachines(SDL_Renderer* renderer) {
+    (void)renderer;
+    const VisibleList* visible = &visibleLists[LEVEL_MACHINES];
+    for (int n = 0; n < visible->count; n++) {
+        int i = visible->indices[n];
+        SDL_Rect machineRect = { machineX[i] - cameraX, machineY[i], GAMBLING_MACHINE_WIDTH, GAMBLING_MACHINE_HEIGHT };
+        batchTexture(gamblingMachineSprite.texture, &gamblingMachineSprite.src, &machineRect, SDL_FLIP_NONE);
+    }
+}
+
+// Player and held gun at their interpolated position; both usually share the atlas page
+void renderPlayer(SDL_Renderer* renderer, const Batarong* batarong, int playerX, int playerY) {
+    SDL_RendererFlip flip = batarong->facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
+    SDL_Rect batarongRect = { playerX - cameraX, playerY, batarong->width, batarong->height }; // Adjust player position
+    batchTexture(batarong->sprite.texture, &batarong->sprite.src, &batarongRect, flip);
+    if (hasGun) {
+        SDL_Rect gunRect = {
+            playerX - cameraX + (batarong->facingLeft ? -32 : batarong->width),
+            playerY + 20,
+            32, 32
+        };
+        batchTexture(gunSprite.texture, &gunSprite.src, &gunRect, flip);
+    }
+    flushRenderBatch(renderer);
+}
+
+void renderRays(SDL_Renderer* renderer) {
+    (void)renderer;
+    const VisibleList* visible = &visibleLists[LEVEL_RAYS];
+    for (int n = 0; n < visible->count; n++) {
+        int i = visible->indices[n];
+        SDL_Rect rayRect = { rayX[i] - cameraX, rayY[i], RAY_WIDTH, RAY_HEIGHT };
+        batchTexture(raySprite.texture, &raySprite.src, &rayRect, SDL_FLIP_NONE);
+    }
+}
+
+/*
+ * Static layer cache. Platforms, gambling machines and Ray never change while
+ * a level is loaded, so they are baked into transparent render-target tiles
+ * of STATIC_TILE_WIDTH world pixels and the screen shows them with one
+ * SDL_RenderCopy per tile (two at most), whatever a tile holds. A few slots
+ * are kept for the tiles on screen and the next one in the direction the
+ * camera moves; a tile is rebaked only when staticLayerGeneration moves on
+ * (level bound, sprites hot reloaded, render targets lost). Bakes read the
+ * level columns directly, so they don't depend on which chunks are resident.
+ * Without render target support the static kinds are culled and drawn every
+ * frame like everything else.
+ */
+typedef struct {
+    SDL_Texture* texture;
+    int tile;               // floor(world x / STATIC_TILE_WIDTH)
+    Uint32 generation;      // staticLayerGeneration when baked; 0 if never
+} StaticTile;
+
+static StaticTile staticTiles[STATIC_TILE_SLOTS];
+static StaticTile* staticVisible[2];    // This frame's tiles, left to right
+static int staticVisibleCount = 0;
+static int staticCameraX = 0;
+static int staticLastCameraX = 0;
+static bool staticLayerDisabled = false;
+
+static int staticTileOf(int worldX) {
+    return worldX >= 0 ? worldX / STATIC_TILE_WIDTH : -((STATIC_TILE_WIDTH - 1 - worldX) / STATIC_TILE_WIDTH);
+}
+
+// Queue one kind's entities in a chunk that overlap area, relative to area; sprite NULL draws platforms
+static void bakeStaticColumn(const SDL_Rect* area, int chunk, int kind, const Sint32* xs, const Sint32* ys,
+                             int w, int h, const Sprite* sprite) {
+    for (int i = chunkStart(chunk, kind); i < chunkStart(chunk + 1, kind); i++) {
+        if (!boxInView(area, xs[i], ys[i], w, h)) continue;
+        SDL_Rect rect = { xs[i] - area->x, ys[i] - area->y, w, h };
+        if (sprite) batchTexture(sprite->texture, &sprite->src, &rect, SDL_FLIP_NONE);
+        else batchFillRect(&rect, platformColor, SDL_BLENDMODE_NONE);
+    }
+}
+
+static bool bakeStaticTile(SDL_Renderer* renderer, StaticTile* slot, int tile) {
+    TRACE_BEGIN("bakeStaticTile");
+    bool baked = SDL_SetRenderTarget(renderer, slot->texture) == 0;
+    if (baked) {
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderClear(renderer);
+        SDL_Rect area = { tile * STATIC_TILE_WIDTH, 0, STATIC_TILE_WIDTH, WINDOW_HEIGHT };
+        int first, last;
+        if (chunkSpan(area.x, area.x + area.w, &first, &last)) {
+            for (int chunk = first; chunk <= last; chunk++) {
+                bakeStaticColumn(&area, chunk, LEVEL_PLATFORMS, platformX, platformY, PLATFORM_WIDTH, PLATFORM_HEIGHT, NULL);
+                bakeStaticColumn(&area, chunk, LEVEL_MACHINES, machineX, machineY, GAMBLING_MACHINE_WIDTH, GAMBLING_MACHINE_HEIGHT, &gamblingMachineSprite);
+                bakeStaticColumn(&area, chunk, LEVEL_RAYS, rayX, rayY, RAY_WIDTH, RAY_HEIGHT, &raySprite);
+            }
+        }
+        flushRenderBatch(renderer);
+        SDL_SetRenderTarget(renderer, NULL);
+        slot->tile = tile;
+        slot->generation = staticLayerGeneration;
+    } else {
+        printf("Unable to draw to static layer tile: %s\n", SDL_GetError());
+    }
+    TRACE_END("bakeStaticTile");
+    return baked;
+}
+
+// The slot holding tile, baking it first if needed; evicts the slot furthest outside [keepFirst, keepLast]
+static StaticTile* acquireStaticTile(SDL_Renderer* renderer, int tile, int keepFirst, int keepLast) {
+    StaticTile* slot = NULL;
+    int furthest = -1;
+    for (int i = 0; i < STATIC_TILE_SLOTS; i++) {
+        StaticTile* candidate = &staticTiles[i];
+        if (candidate->generation != 0 && candidate->tile == tile) {
+            slot = candidate;
+            break;
+        }
+        int distance = INT32_MAX;
+        if (candidate->generation != 0) {
+            distance = candidate->tile < keepFirst ? keepFirst - candidate->tile :
+                       candidate->tile > keepLast ? candidate->tile - keepLast : 0;
+        }
+        if (distance > furthest) {
+            furthest = distance;
+            slot = candidate;
+        }
+    }
+    if (slot->generation == staticLayerGeneration && slot->tile == tile) return slot;
+    if (!slot->texture) {
+        slot->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                          STATIC_TILE_WIDTH, WINDOW_HEIGHT);
+        if (!slot->texture) {
+            printf("Unable to create static layer tile, drawing the level per frame: %s\n", SDL_GetError());
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(slot->texture, SDL_BLENDMODE_BLEND);
+    }
+    slot->generation = 0;
+    return bakeStaticTile(renderer, slot, tile) ? slot : NULL;
+}
+
+// Before the frame is cleared: make sure the tiles under the camera are baked, and at most one
+// ahead of it. Returns false when the static kinds have to be drawn per frame instead.
+static bool updateStaticLayer(SDL_Renderer* renderer, int camera) {
+    staticVisibleCount = 0;
+    if (staticLayerDisabled) return false;
+    if (!staticTiles[0].texture && !SDL_RenderTargetSupported(renderer)) {
+        printf("Render targets unsupported, drawing the level per frame\n");
+        staticLayerDisabled = true;
+        return false;
+    }
+    int first = staticTileOf(camera), last = staticTileOf(camera + STREAM_VIEW_WIDTH - 1);
+    int ahead = camera > staticLastCameraX ? last + 1 : camera < staticLastCameraX ? first - 1 : first;
+    int keepFirst = ahead < first ? ahead : first, keepLast = ahead > last ? ahead : last;
+    staticLastCameraX = camera;
+    for (int tile = first; tile <= last; tile++) {
+        StaticTile* slot = acquireStaticTile(renderer, tile, keepFirst, keepLast);
+        if (!slot) {
+            staticLayerDisabled = true;
+            staticVisibleCount = 0;
+            return false;
+        }
+        staticVisible[staticVisibleCount++] = slot;
+    }
+    if (ahead < first || ahead > last) acquireStaticTile(renderer, ahead, keepFirst, keepLast);
+    staticCameraX = camera;
+    return true;
+}
+
+// Composite the tiles chosen by updateStaticLayer()
+static void drawStaticLayer(SDL_Renderer* renderer) {
+    for (int i = 0; i < staticVisibleCount; i++) {
+        const StaticTile* slot = staticVisible[i];
+        SDL_Rect dst = { slot->tile * STATIC_TILE_WIDTH - staticCameraX, 0, STATIC_TILE_WIDTH, WINDOW_HEIGHT };
+        SDL_RenderCopy(renderer, slot->texture, NULL, &dst);
+    }
+}
+
+static void destroyStaticLayer(void) {
+    for (int i = 0; i < STATIC_TILE_SLOTS; i++) {
+        if (staticTiles[i].texture) SDL_DestroyTexture(staticTiles[i].texture);
+    }
+    memset(staticTiles, 0, sizeof(staticTiles));
+    staticVisibleCount = 0;
+}
+
+void renderGameOver(SDL_Renderer* renderer, TTF_Font* font) {
+    // Fill the entire screen with black
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_Rect fullscreenRect = { 0, 0, 800, 600 };
+    SDL_RenderFillRect(renderer, &fullscreenRect);
+
+    // Center the "Game Over" text
+    SDL_Color textColor = { 255, 255, 255 }; // White color for text
+    renderText(renderer, font, "Game Over", textColor, 300, 250);
+
+    // Center the "Press R to Restart" text
+    renderText(renderer, font, "Press R to Restart", textColor, 270, 300);
+
+    // Add piwo count to the game over screen
+    char scoreText[32];
+    sprintf(scoreText, "piwo count: %d", piwoCount);
+    renderText(renderer, font, scoreText, textColor, 300, 350);
+}
+
+void renderPauseScreen(SDL_Renderer* renderer, TTF_Font* font) {
+    // Dim screen with semi-transparent overlay (simulate by drawing a dark rectangle)
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_Rect overlay = {0, 0, 800, 600};
+    SDL_RenderFillRect(renderer, &overlay);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+    SDL_Color textColor = {255, 255, 255};
+    renderText(renderer, font, "Paused", textColor, 360, 240);
+    renderText(renderer, font, "Press ESC to Resume", textColor, 300, 280);
+}
+
+// Modify renderSprintBar function to show shop prompt when near Ray
+void renderSprintBar(SDL_Renderer* renderer, float sprintEnergy, Batarong* batarong, TTF_Font* font) {
+    // Draw sprint bar background
+    SDL_Rect bgRect = { 10, 560, SPRINT_BAR_WIDTH, SPRINT_BAR_HEIGHT };
+    batchFillRect(&bgRect, (SDL_Color){100, 100, 100, 255}, SDL_BLENDMODE_NONE);
+
+    // Draw sprint energy level
+    SDL_Rect energyRect = { 10, 560, (int)(SPRINT_BAR_WIDTH * (sprintEnergy / MAX_SPRINT_ENERGY)), SPRINT_BAR_HEIGHT };
+    batchFillRect(&energyRect, (SDL_Color){0, 255, 255, 255}, SDL_BLENDMODE_NONE);
+    flushRenderBatch(renderer);
+
+    // Show prompts next to sprint bar
+    SDL_Color promptColor = {255, 255, 255};
+    if (playerTriggers.machine >= 0) {
+        renderText(renderer, font, "Press A to gamble", promptColor, SPRINT_BAR_WIDTH + 30, 560);
+    } else if (playerTriggers.ray >= 0) {
+        renderText(renderer, font, "Press A to enter shop", promptColor, SPRINT_BAR_WIDTH + 30, 560);
+    }
+}
+
+/*
+ * Projectile hits. After the integrate pass each bullet is tested against
+ * projectileTargets; level columns are sorted by x, so a bullet binary-searches
+ * the chunks it overlaps for the first target that can reach it instead of
+ * scanning them. A hit absorbs the bullet and counts in projectileHitTotal;
+ * targets don't react yet. New kinds of target (enemies) are one more table
+ * row, and whatever reacts to hits goes where updateBullets() finds one.
+ */
+typedef struct {
+    int kind;                   // LEVEL_* column
+    const Sint32* const* xs;    // Address of the column pointer; columns move when a level loads
+    const Sint32* const* ys;
+    int w, h;
+} ProjectileTarget;
+
+static const ProjectileTarget projectileTargets[] = {
+    { LEVEL_RAYS, &rayX, &rayY, RAY_WIDTH, RAY_HEIGHT },
+    { LEVEL_MACHINES, &machineX, &machineY, GAMBLING_MACHINE_WIDTH, GAMBLING_MACHINE_HEIGHT },
+};
+
+static Uint32 projectileHitTotal = 0;         // Hits since the last resetSimulation()
+
+// Index of a target in chunks [first, last] overlapping the box, or -1
+static int findProjectileTarget(const ProjectileTarget* target, int first, int last, float x, float y, float w, float h) {
+    const Sint32* xs = *target->xs;
+    const Sint32* ys = *target->ys;
+    int lo = chunkStart(first, target->kind);
+    int end = chunkStart(last + 1, target->kind);
+    int hi = end;
+    // First target whose right edge is past the box's left edge
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (xs[mid] + target->w <= x) lo = mid + 1;
+        else hi = mid;
+    }
+    for (int i = lo; i < end && xs[i] < x + w; i++) {
+        if (ys[i] < y + h && ys[i] + target->h > y) return i;
+    }
+    return -1;
+}
+
+// Add these new functions before main()
+void shootBullet(Batarong* batarong) {
+    Uint32 currentTime = simTimeMs();
+    if (currentTime - lastShotTime < SHOOT_COOLDOWN) {
+        return;  // Don't shoot if cooldown hasn't elapsed
+    }
+
+    float x = batarong->x + (batarong->facingLeft ? 0 : batarong->width);
+    float y = (float)((int)batarong->y + (batarong->height / 2));
+    EntityHandle bullet = spawnEntity(&bulletStore, x, y, BULLET_WIDTH, BULLET_HEIGHT);
+    int row = entityRow(&bulletStore, bullet);
+    if (row < 0) return;
+    bulletStore.vx[row] = (batarong->facingLeft ? -BULLET_SPEED : BULLET_SPEED) * SIM_TICK_SCALE;
+    if (batarong->facingLeft) bulletStore.flags[row] |= ENTITY_FACING_LEFT;
+    lastShotTime = currentTime;
+}
+
+void updateBullets(void) {
+    EntityStore* bullets = &bulletStore;
+    integrateEntities(bullets);
+
+    const float minX = (float)(simCameraX - BULLET_CULL_MARGIN);
+    const float maxX = (float)(simCameraX + STREAM_VIEW_WIDTH + BULLET_CULL_MARGIN);
+    const float minY = (float)-BULLET_CULL_MARGIN;
+    const float maxY = (float)(WINDOW_HEIGHT + BULLET_CULL_MARGIN);
+    const int targetCount = (int)(sizeof(projectileTargets) / sizeof(projectileTargets[0]));
+    for (int i = 0; i < bullets->count; ) {
+        float x = bullets->x[i], y = bullets->y[i];
+        bool gone = x < minX || x > maxX || y < minY || y > maxY;
+        int first = 0, last = -1;
+        if (!gone) chunkSpan((int)x, (int)(x + bullets->w[i]), &first, &last);
+        for (int t = 0; t < targetCount && !gone && first <= last; t++) {
+            if (findProjectileTarget(&projectileTargets[t], first, last, x, y, bullets->w[i], bullets->h[i]) >= 0) {
+                projectileHitTotal++;
+                gone = true;
+            }
+        }
+        if (gone) {
+            removeEntityRow(bullets, i);
+            continue; // Don't increment i; the last row moved here and needs processing
+        }
+        i++;
+    }
+}
+
+void renderBullets(SDL_Renderer* renderer, float alpha) {
+    const VisibleList* visible = &visibleLists[VISIBLE_BULLETS];
+    const SDL_Color bulletColor = {255, 255, 0, 255};  // Yellow bullets
+    const EntityStore* bullets = &bulletStore;
+    for (int n = 0; n < visible->count; n++) {
+        int i = visible->indices[n];
+        float x = bullets->prevX[i] + (bullets->x[i] - bullets->prevX[i]) * alpha;
+        SDL_Rect bulletRect = {
+            (int)x - cameraX,
+            (int)bullets->y[i],
+            (int)bullets->w[i],
+            (int)bullets->h[i]
+        };
+        batchFillRect(&bulletRect, bulletColor, SDL_BLENDMODE_NONE);
+    }
+    flushRenderBatch(renderer);
+}
+
+/*
+ * Frame profiler. PROFILE(phase, statement) adds the statement's time to a
+ * phase of the current frame; simulation phases sum over every tick that ran
+ * in the frame. profileEndFrame() closes the frame into a PROFILE_HISTORY ring
+ * together with the frame's wall time and cullStats. F3 toggles an overlay
+ * with each phase's rolling average and p99 over PROFILE_WINDOW frames plus a
+ * frame-time graph, and the ring is written to PROFILE_CSV_PATH at exit.
+ * Without -DPROFILER PROFILE() is just its statement and the rest is not built.
+ */
+enum {
+    PROFILE_INPUT,
+    PROFILE_GRAVITY,
+    PROFILE_COLLISION,
+    PROFILE_BULLETS,
+    PROFILE_CULL,
+    PROFILE_STATIC_LAYER,
+    PROFILE_PLATFORMS,
+    PROFILE_MACHINES,
+    PROFILE_PIWO,
+    PROFILE_RAYS,
+    PROFILE_FLUSH,
+    PROFILE_PLAYER,
+    PROFILE_SCREENS,        // Game over, gambling, shop and pause
+    PROFILE_HUD,
+    PROFILE_RENDER_BULLETS,
+    PROFILE_DIALOG,
+    PROFILE_PRESENT,
+    PROFILE_PHASE_COUNT
+};
+
+#if defined(PROFILER) || defined(TRACING)
+static const char* profilePhaseNames[PROFILE_PHASE_COUNT] = {
+    "handleInput", "applyGravity", "checkCollision", "updateBullets", "cullWorld",
+    "staticLayer", "renderPlatforms", "renderMachines", "renderPiwo", "renderRays", "batch flush",
+    "renderPlayer", "screens", "hud", "renderBullets", "dialog", "present"
+};
+#endif
+
+#ifdef PROFILER
+
+typedef struct {
+    float phaseUs[PROFILE_PHASE_COUNT];
+    float frameUs;          // Wall time since the previous frame ended
+    int drawn, culled;      // cullStats for the frame
+} ProfileFrame;
+
+static ProfileFrame profileFrames[PROFILE_HISTORY];
+static ProfileFrame profileCurrent;
+static Uint64 profileFrameCount = 0;
+static Uint64 profileLastCounter = 0;
+static double profileUsPerCount = 0.0;
+static bool profileOverlay = false;
+static char profileLines[PROFILE_PHASE_COUNT + 1][64];   // Overlay text, rebuilt every PROFILE_OVERLAY_REFRESH frames
+
+#define PROFILE_TIME(phase, ...) do { \
+        Uint64 profileStart = SDL_GetPerformanceCounter(); \
+        __VA_ARGS__; \
+        profileCurrent.phaseUs[phase] += (float)((double)(SDL_GetPerformanceCounter() - profileStart) * profileUsPerCount); \
+    } while (0)
+
+static void profileStart(void) {
+    profileUsPerCount = 1e6 / (double)SDL_GetPerformanceFrequency();
+    profileLastCounter = SDL_GetPerformanceCounter();
+}
+
+static void profileEndFrame(void) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    profileCurrent.frameUs = (float)((double)(now - profileLastCounter) * profileUsPerCount);
+    profileCurrent.drawn = cullStats.drawn;
+    profileCurrent.culled = cullStats.culled;
+    profileFrames[profileFrameCount % PROFILE_HISTORY] = profileCurrent;
+    profileFrameCount++;
+    profileLastCounter = now;
+    memset(&profileCurrent, 0, sizeof(profileCurrent));
+}
+
+// F3 toggles the overlay
+static void profileHandleEvent(const SDL_Event* event) {
+    if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_F3 && !event->key.repeat) profileOverlay = !profileOverlay;
+}
+
+static int compareFloats(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Average and p99 of a phase (PROFILE_PHASE_COUNT for the whole frame) over the last count frames
+static void profilePhaseStats(int phase, int count, float* average, float* p99) {
+    float samples[PROFILE_WINDOW];
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) {
+        const ProfileFrame* frame = &profileFrames[(profileFrameCount - 1 - (Uint64)i) % PROFILE_HISTORY];
+        samples[i] = phase < PROFILE_PHASE_COUNT ? frame->phaseUs[phase] : frame->frameUs;
+        sum += samples[i];
+    }
+    qsort(samples, (size_t)count, sizeof(float), compareFloats);
+    *average = (float)(sum / count);
+    *p99 = samples[(count * 99) / 100 < count ? (count * 99) / 100 : count - 1];
+}
+
+static void drawProfileOverlay(SDL_Renderer* renderer, TTF_Font* font) {
+    if (!profileOverlay || profileFrameCount == 0) return;
+    int count = profileFrameCount < PROFILE_WINDOW ? (int)profileFrameCount : PROFILE_WINDOW;
+    if (profileFrameCount % PROFILE_OVERLAY_REFRESH == 1 || profileLines[0][0] == '\0') {
+        for (int phase = 0; phase <= PROFILE_PHASE_COUNT; phase++) {
+            float average, p99;
+            profilePhaseStats(phase, count, &average, &p99);
+            snprintf(profileLines[phase], sizeof(profileLines[phase]), "%-16s %8.1f %8.1f",
+                     phase < PROFILE_PHASE_COUNT ? profilePhaseNames[phase] : "frame", average, p99);
+        }
+    }
+
+    const int lineHeight = 16, panelX = 440, panelY = 40, panelW = 350;
+    const int graphH = 60, graphY = panelY + lineHeight * (PROFILE_PHASE_COUNT + 2) + 8;
+    SDL_Rect panel = { panelX, panelY, panelW, graphY + graphH + 8 - panelY };
+    batchFillRect(&panel, (SDL_Color){ 0, 0, 0, 180 }, SDL_BLENDMODE_BLEND);
+
+    // Frame-time graph: one bar per frame, oldest on the left; the line marks the 60 fps budget
+    const float usPerPixel = 33333.0f / graphH;
+    for (int i = 0; i < count; i++) {
+        const ProfileFrame* frame = &profileFrames[(profileFrameCount - (Uint64)count + (Uint64)i) % PROFILE_HISTORY];
+        int h = (int)(frame->frameUs / usPerPixel);
+        if (h > graphH) h = graphH;
+        SDL_Rect bar = { panelX + 8 + i * (panelW - 16) / PROFILE_WINDOW, graphY + graphH - h, 1, h };
+        SDL_Color color = frame->frameUs > 16667.0f ? (SDL_Color){ 255, 80, 80, 255 } : (SDL_Color){ 80, 255, 80, 255 };
+        batchFillRect(&bar, color, SDL_BLENDMODE_NONE);
+    }
+    SDL_Rect budget = { panelX + 8, graphY + graphH - (int)(16667.0f / usPerPixel), panelW - 16, 1 };
+    batchFillRect(&budget, (SDL_Color){ 255, 255, 255, 255 }, SDL_BLENDMODE_NONE);
+    flushRenderBatch(renderer);
+
+    const SDL_Color textColor = { 255, 255, 255, 255 };
+    renderText(renderer, font, "phase              avg us   p99 us", textColor, panelX + 8, panelY + 4);
+    for (int phase = 0; phase <= PROFILE_PHASE_COUNT; phase++) {
+        renderText(renderer, font, profileLines[phase], textColor, panelX + 8, panelY + 4 + lineHeight * (phase + 1));
+    }
+}
+
+// Every frame still in the ring, oldest first, in microseconds
+static void writeProfileCsv(const char* path) {
+    if (profileFrameCount == 0) return;
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Error writing profile: %s\n", path);
+        return;
+    }
+    fprintf(file, "frame,frame_us");
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) fprintf(file, ",%s", profilePhaseNames[phase]);
+    fprintf(file, ",drawn,culled\n");
+    Uint64 first = profileFrameCount > PROFILE_HISTORY ? profileFrameCount - PROFILE_HISTORY : 0;
+    for (Uint64 n = first; n < profileFrameCount; n++) {
+        const ProfileFrame* frame = &profileFrames[n % PROFILE_HISTORY];
+        fprintf(file, "%llu,%.1f", (unsigned long long)n, frame->frameUs);
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) fprintf(file, ",%.1f", frame->phaseUs[phase]);
+        fprintf(file, ",%d,%d\n", frame->drawn, frame->culled);
+    }
+    if (fclose(file) == 0) printf("Profile of %llu frames written to %s\n", (unsigned long long)(profileFrameCount - first), path);
+}
+#else
+#define PROFILE_TIME(phase, ...) do { __VA_ARGS__; } while (0)
+#endif
+
+// Time a phase for the profiler and bracket it in the trace; just the statement when neither is built
+#define PROFILE(phase, ...) TRACE(profilePhaseNames[phase], PROFILE_TIME(phase, __VA_ARGS__))
+
+// Remember where everything was at the start of a tick so frames can interpolate
+static void beginSimTick(Batarong* batarong) {
+    batarong->prevX = batarong->x;
+    batarong->prevY = batarong->y;
+    if (bulletStore.count > 0) { // Columns are NULL until the first spawn
+        memcpy(bulletStore.prevX, bulletStore.x, sizeof(float) * (size_t)bulletStore.count);
+        memcpy(bulletStore.prevY, bulletStore.y, sizeof(float) * (size_t)bulletStore.count);
+    }
+}
+
+// Optional per-call timing of the hot simulation steps (benchmark only)
+typedef struct {
+    Uint64 collisionCounter;
+    Uint64 collisionCalls;
+    Uint64 bulletCounter;
+    Uint64 bulletCalls;
+} SimTimings;
+
+static SimTimings* simTimings = NULL;
+
+// Advance the whole game by one fixed tick. Shared by the windowed loop and headless runs.
+static void simulateTick(Batarong* batarong, bool* gameOver, const InputState* input) {
+    beginSimTick(batarong);
+
+    // Handle input
+    PROFILE(PROFILE_INPUT, handleInput(batarong, gameOver, input));
+
+    if (!*gameOver && !isPaused) {
+        // Apply gravity
+        PROFILE(PROFILE_GRAVITY, applyGravity(batarong));
+
+        // Check for collisions with platforms and piwo
+        if (simTimings) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            checkCollision(batarong, gameOver);
+            simTimings->collisionCounter += SDL_GetPerformanceCounter() - start;
+            simTimings->collisionCalls++;
+        } else {
+            PROFILE(PROFILE_COLLISION, checkCollision(batarong, gameOver));
+        }
+
+        // Add bullet updates here
+        if (simTimings) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            updateBullets();
+            simTimings->bulletCounter += SDL_GetPerformanceCounter() - start;
+            simTimings->bulletCalls++;
+        } else {
+            PROFILE(PROFILE_BULLETS, updateBullets());
+        }
+
+        updateGambling();
+    }
+
+    simCameraX = (int)batarong->x - (800 / 2);
+    updateWorldStreaming(simCameraX, batarong->facingLeft);
+    simTickCount++;
+}
+
+// Put every piece of global game state back to a fresh run
+static void resetSimulation(Batarong* batarong) {
+    memset(batarong, 0, sizeof(*batarong));
+    batarong->x = batarong->prevX = 300;
+    batarong->y = batarong->prevY = 400;
+    batarong->width = PLAYER_DEFAULT_WIDTH;
+    batarong->height = PLAYER_DEFAULT_HEIGHT;
+    batarong->onGround = true;
+    batarong->sprintEnergy = MAX_SPRINT_ENERGY;
+    batarong->sprintKeyReleased = true;
+    memset(piwoCollected, 0, sizeof(bool) * (size_t)piwoListCount);
+    saveDirtySections = SAVE_ALL_SECTIONS;
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) shopItems[i].purchased = false;
+    clearEntityStore(&bulletStore);
+    projectileHitTotal = 0;
+    piwoCount = 0;
+    hasGun = false;
+    lastShotTime = 0;
+    isGambling = isShoppingOpen = isPaused = false;
+    isSpinning = resultDisplayed = showError = false;
+    currentBet = lastWinnings = spinResult = 0;
+    betInput.length = 0;
+    betInput.text[0] = '\0';
+    aKeyPressed = bKeyPressed = escKeyPressed = false;
+    currentRay = -1;
+    scanPlayerOverlaps(batarong, false);
+    simTickCount = 0;
+    simRngState = simRngSeed;
+    simCameraX = (int)batarong->x - (800 / 2);
+    updateWorldStreaming(simCameraX, batarong->facingLeft);
+}
+
+/*
+ * Input recording and replay. A recording holds everything needed to rerun a
+ * session bit-exactly: the RNG seed, the player's size, the shop prices
+ * config gave (frozen while recording, since a hot reload can't be replayed;
+ * headless replays never read config), the per-tick
+ * InputState run-length encoded as ReplayRuns (a run can't span typed bet
+ * keys, which belong to its first tick) and a hashWorldState() every
+ * hashInterval ticks. Replaying feeds the runs back in place of the keyboard
+ * or the script and compares each hash as it goes, so the first divergent
+ * tick is reported. Recordings are only valid for the same level file
+ * (levelHash) and SIM_TICK_HZ, and bit-exact only with the same build.
+ *
+ * File layout: ReplayHeader, Uint64 hashes[hashCount], ReplayRun
+ * runs[runCount], char keys[keyCount]; little-endian, written as-is.
+ */
+#define REPLAY_FLAG_ARMED (1u << 0)     // Run started with the gun (headless runs)
+
+typedef struct {
+    char magic[4];
+    Uint32 version;
+    Uint32 tickHz;
+    Uint32 seed;
+    Uint32 flags;
+    Uint32 tickCount;
+    Uint32 hashInterval;
+    Uint32 hashCount;
+    Uint32 runCount;
+    Uint32 keyCount;
+    Sint32 playerWidth, playerHeight;
+    Sint32 shopPrices[SHOP_ITEM_COUNT];
+    Uint64 levelHash;
+} ReplayHeader;
+
+typedef struct {
+    Uint16 buttons;
+    Uint8 ticks;        // Consecutive ticks holding these buttons, 1-255
+    Uint8 keyCount;     // Bet keys typed on the run's first tick, next in keys[]
+} ReplayRun;
+
+typedef struct {
+    ReplayHeader header;
+    Uint64* hashes;
+    ReplayRun* runs;
+    char* keys;
+    Uint32 hashCapacity, runCapacity, keyCapacity;
+    bool recording, replaying;
+    char path[256];         // Where a recording is written
+    // Replay cursor
+    Uint32 tick, run, runTick, key, hash;
+    Uint32 divergedTick;    // First tick whose hash didn't match, or UINT32_MAX
+} InputReplay;
+
+static InputReplay inputReplay = {0};
+
+// Everything a tick can change, folded into one FNV-1a hash
+static Uint64 hashWorldState(const Batarong* batarong, bool gameOver) {
+    Uint64 hash = hashBytes(&simTickCount, sizeof(simTickCount));
+#define HASH_FIELD(field) hash = hashBytesFrom(hash, &(field), sizeof(field))
+    HASH_FIELD(simRngState);
+    HASH_FIELD(gameOver);
+    HASH_FIELD(batarong->x);
+    HASH_FIELD(batarong->y);
+    HASH_FIELD(batarong->width);
+    HASH_FIELD(batarong->height);
+    HASH_FIELD(batarong->velocityX);
+    HASH_FIELD(batarong->velocityY);
+    HASH_FIELD(batarong->onGround);
+    HASH_FIELD(batarong->isSprinting);
+    HASH_FIELD(batarong->sprintEnergy);
+    HASH_FIELD(batarong->facingLeft);
+    HASH_FIELD(batarong->sprintKeyReleased);
+    HASH_FIELD(piwoCount);
+    HASH_FIELD(hasGun);
+    HASH_FIELD(lastShotTime);
+    HASH_FIELD(isGambling);
+    HASH_FIELD(isShoppingOpen);
+    HASH_FIELD(isPaused);
+    HASH_FIELD(isSpinning);
+    HASH_FIELD(resultDisplayed);
+    HASH_FIELD(showError);
+    HASH_FIELD(currentBet);
+    HASH_FIELD(lastWinnings);
+    HASH_FIELD(spinResult);
+    HASH_FIELD(betInput.length);
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) {
+        HASH_FIELD(shopItems[i].price);
+        HASH_FIELD(shopItems[i].purchased);
+    }
+#undef HASH_FIELD
+    hash = hashBytesFrom(hash, betInput.text, (size_t)betInput.length);
+    hash = hashBytesFrom(hash, piwoCollected, sizeof(bool) * (size_t)piwoListCount);
+    size_t rows = (size_t)bulletStore.count;
+    hash = hashBytesFrom(hash, &bulletStore.count, sizeof(bulletStore.count));
+    if (rows > 0) {
+        hash = hashBytesFrom(hash, bulletStore.x, sizeof(float) * rows);
+        hash = hashBytesFrom(hash, bulletStore.y, sizeof(float) * rows);
+        hash = hashBytesFrom(hash, bulletStore.vx, sizeof(float) * rows);
+        hash = hashBytesFrom(hash, bulletStore.vy, sizeof(float) * rows);
+        hash = hashBytesFrom(hash, bulletStore.flags, sizeof(Uint32) * rows);
+    }
+    return hash;
+}
+
+static Uint64 levelFileHash(void) {
+    if (!levelHashValid) {
+        levelHash = levelFile.data ? hashBytes(levelFile.data, levelFile.size) : 0;
+        levelHashValid = true;
+    }
+    return levelHash;
+}
+
+static void freeInputReplay(void) {
+    free(inputReplay.hashes);
+    free(inputReplay.runs);
+    free(inputReplay.keys);
+    memset(&inputReplay, 0, sizeof(inputReplay));
+    replayStateLocked = false;
+}
+
+// Grow one of the recording's arrays to hold at least one more element
+static bool growReplayArray(void** array, Uint32* capacity, Uint32 count, size_t elementSize) {
+    if (count < *capacity) return true;
+    Uint32 newCapacity = *capacity ? *capacity * 2 : 1024;
+    void* grown = realloc(*array, elementSize * newCapacity);
+    if (!grown) {
+        printf("Out of memory recording input; recording stopped\n");
+        return false;
+    }
+    *array = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+// Start recording from the current (freshly reset) state
+static void startRecording(const char* path, const Batarong* batarong) {
+    freeInputReplay();
+    ReplayHeader* header = &inputReplay.header;
+    memcpy(header->magic, REPLAY_MAGIC, 4);
+    header->version = REPLAY_VERSION;
+    header->tickHz = SIM_TICK_HZ;
+    header->seed = simRngSeed;
+    header->flags = hasGun ? REPLAY_FLAG_ARMED : 0;
+    header->hashInterval = REPLAY_HASH_INTERVAL;
+    header->playerWidth = batarong->width;
+    header->playerHeight = batarong->height;
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) header->shopPrices[i] = shopItems[i].price;
+    header->levelHash = levelFileHash();
+    snprintf(inputReplay.path, sizeof(inputReplay.path), "%s", path);
+    inputReplay.recording = true;
+    replayStateLocked = true;
+}
+
+static void recordInput(const InputState* input) {
+    ReplayHeader* header = &inputReplay.header;
+    ReplayRun* last = header->runCount ? &inputReplay.runs[header->runCount - 1] : NULL;
+    if (last && last->buttons == input->buttons && last->ticks < 255 && input->keyCount == 0) {
+        last->ticks++;
+        return;
+    }
+    if (!growReplayArray((void**)&inputReplay.runs, &inputReplay.runCapacity, header->runCount, sizeof(ReplayRun))) {
+        inputReplay.recording = false;
+        return;
+    }
+    for (int i = 0; i < input->keyCount; i++) {
+        if (!growReplayArray((void**)&inputReplay.keys, &inputReplay.keyCapacity, header->keyCount, 1)) {
+            inputReplay.recording = false;
+            return;
+        }
+        inputReplay.keys[header->keyCount++] = input->keys[i];
+    }
+    ReplayRun run = { input->buttons, 1, input->keyCount };
+    inputReplay.runs[header->runCount++] = run;
+}
+
+// Next recorded InputState; false once the recording is exhausted
+static bool replayInput(InputState* input) {
+    const ReplayHeader* header = &inputReplay.header;
+    if (inputReplay.run >= header->runCount) return false;
+    const ReplayRun* run = &inputReplay.runs[inputReplay.run];
+    input->buttons = run->buttons;
+    input->keyCount = 0;
+    if (inputReplay.runTick == 0) {
+        input->keyCount = run->keyCount;
+        memcpy(input->keys, inputReplay.keys + inputReplay.key, run->keyCount);
+        inputReplay.key += run->keyCount;
+    }
+    if (++inputReplay.runTick == run->ticks) {
+        inputReplay.run++;
+        inputReplay.runTick = 0;
+    }
+    return true;
+}
+
+/*
+ * Per-tick hooks around simulateTick(). replayTickInput() swaps in the
+ * recorded input when replaying (false when it runs out) or appends the live
+ * input when recording; replayTickHash() records or checks the world hash.
+ */
+static bool replayTickInput(InputState* input) {
+    if (inputReplay.replaying) return replayInput(input);
+    if (inputReplay.recording) recordInput(input);
+    return true;
+}
+
+static void recordHash(const Batarong* batarong, bool gameOver) {
+    ReplayHeader* header = &inputReplay.header;
+    if (!growReplayArray((void**)&inputReplay.hashes, &inputReplay.hashCapacity, header->hashCount, sizeof(Uint64))) {
+        inputReplay.recording = false;
+        return;
+    }
+    inputReplay.hashes[header->hashCount++] = hashWorldState(batarong, gameOver);
+}
+
+static void replayTickHash(const Batarong* batarong, bool gameOver) {
+    if (!inputReplay.recording && !inputReplay.replaying) return;
+    ReplayHeader* header = &inputReplay.header;
+    inputReplay.tick++;
+    if (inputReplay.recording) {
+        header->tickCount = inputReplay.tick;
+        if (inputReplay.tick % header->hashInterval == 0) recordHash(batarong, gameOver);
+        return;
+    }
+    // The final tick is always hashed too, whatever the interval
+    if (inputReplay.tick % header->hashInterval != 0 && inputReplay.tick != header->tickCount) return;
+    Uint64 hash = hashWorldState(batarong, gameOver);
+    if (inputReplay.hash < header->hashCount) {
+        if (inputReplay.hashes[inputReplay.hash] != hash && inputReplay.divergedTick == UINT32_MAX) {
+            inputReplay.divergedTick = inputReplay.tick;
+            printf("replay: world state diverged by tick %u (hash %016llx, recorded %016llx)\n", inputReplay.tick,
+                   (unsigned long long)hash, (unsigned long long)inputReplay.hashes[inputReplay.hash]);
+        }
+        inputReplay.hash++;
+    }
+}
+
+// Hash the final state (unless the last tick already was) and write out the recording
+static bool finishRecording(const Batarong* batarong, bool gameOver) {
+    ReplayHeader* header = &inputReplay.header;
+    if (inputReplay.recording && header->tickCount % header->hashInterval != 0) recordHash(batarong, gameOver);
+    if (!inputReplay.recording) {
+        freeInputReplay();
+        return false;
+    }
+
+    bool ok = false;
+    FILE* file = fopen(inputReplay.path, "wb");
+    if (file) {
+        ok = fwrite(header, sizeof(*header), 1, file) == 1 &&
+             (header->hashCount == 0 || fwrite(inputReplay.hashes, sizeof(Uint64), header->hashCount, file) == header->hashCount) &&
+             (header->runCount == 0 || fwrite(inputReplay.runs, sizeof(ReplayRun), header->runCount, file) == header->runCount) &&
+             (header->keyCount == 0 || fwrite(inputReplay.keys, 1, header->keyCount, file) == header->keyCount);
+        if (fclose(file) != 0) ok = false;
+    }
+    if (ok) {
+        printf("Recording of %u ticks (%u runs, %u hashes) written to %s\n", header->tickCount, header->runCount,
+               header->hashCount, inputReplay.path);
+    } else {
+        printf("Error writing recording %s\n", inputReplay.path);
+    }
+    freeInputReplay();
+    return ok;
+}
+
+// Load a recording made on the current level; beginReplay() starts it
+static bool loadReplay(const char* path) {
+    freeInputReplay();
+    MemoryFile file = {0};
+    if (mapFileToMemory(path, &file) != 0) {
+        printf("Unable to load recording: %s\n", path);
+        return false;
+    }
+    ReplayHeader header;
+    bool valid = file.size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, file.data, sizeof(header));
+        valid = memcmp(header.magic, REPLAY_MAGIC, 4) == 0 && header.version == REPLAY_VERSION &&
+                header.hashInterval > 0 &&
+                file.size == sizeof(header) + (Uint64)header.hashCount * sizeof(Uint64) +
+                             (Uint64)header.runCount * sizeof(ReplayRun) + header.keyCount;
+        for (int i = 0; valid && i < SHOP_ITEM_COUNT; i++) valid = header.shopPrices[i] >= 0;
+    }
+    if (!valid) {
+        printf("Not a valid recording: %s\n", path);
+    } else if (header.tickHz != SIM_TICK_HZ) {
+        printf("Recording %s was made at %u Hz; rebuild with SIM_TICK_HZ=%u to replay it\n", path, header.tickHz, header.tickHz);
+        valid = false;
+    } else if (header.levelHash != levelFileHash()) {
+        printf("Recording %s was made on a different level\n", path);
+        valid = false;
+    }
+    if (valid) {
+        const unsigned char* data = (const unsigned char*)file.data + sizeof(header);
+        size_t hashBytesSize = sizeof(Uint64) * header.hashCount, runBytes = sizeof(ReplayRun) * header.runCount;
+        inputReplay.hashes = malloc(hashBytesSize ? hashBytesSize : 1);
+        inputReplay.runs = malloc(runBytes ? runBytes : 1);
+        inputReplay.keys = malloc(header.keyCount ? header.keyCount : 1);
+        if (!inputReplay.hashes || !inputReplay.runs || !inputReplay.keys) {
+            printf("Out of memory loading recording %s\n", path);
+            valid = false;
+        } else {
+            memcpy(inputReplay.hashes, data, hashBytesSize);
+            memcpy(inputReplay.runs, data + hashBytesSize, runBytes);
+            memcpy(inputReplay.keys, data + hashBytesSize + runBytes, header.keyCount);
+            // Runs must account for exactly their keys
+            Uint64 keys = 0;
+            for (Uint32 i = 0; i < header.runCount; i++) keys += inputReplay.runs[i].keyCount;
+            if (keys != header.keyCount) {
+                printf("Not a valid recording: %s\n", path);
+                valid = false;
+            }
+        }
+    }
+    releaseMemoryFile(&file);
+    if (!valid) {
+        freeInputReplay();
+        return false;
+    }
+    inputReplay.header = header;
+    inputReplay.replaying = true;
+    inputReplay.divergedTick = UINT32_MAX;
+    simRngSeed = header.seed;
+    return true;
+}
+
+// Put a freshly reset run into the recording's starting conditions
+static void beginReplay(Batarong* batarong) {
+    const ReplayHeader* header = &inputReplay.header;
+    simRngState = header->seed;
+    hasGun = (header->flags & REPLAY_FLAG_ARMED) != 0;
+    batarong->width = header->playerWidth;
+    batarong->height = header->playerHeight;
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) shopItems[i].price = header->shopPrices[i];
+    replayStateLocked = true;
+    scanPlayerOverlaps(batarong, false);
+}
+
+// Report how the replay went; true if every hash matched
+static bool finishReplay(void) {
+    bool matched = inputReplay.divergedTick == UINT32_MAX && inputReplay.hash == inputReplay.header.hashCount;
+    printf("replay: %u ticks, %u/%u hashes checked, %s\n", inputReplay.tick, inputReplay.hash,
+           inputReplay.header.hashCount, matched ? "all matched" : "FAILED");
+    freeInputReplay();
+    return matched;
+}
+
+/*
+ * Save states. A save file is a SaveHeader followed by two slots per
+ * SaveSection, each with spare capacity: the one the header points at and a
+ * spare. A later save writes a changed section into its spare slot (or two
+ * new slots at the end of the file when it outgrows them) and the header
+ * then swaps the pair, so the sections the old header points at are never
+ * overwritten. The header also records the FNV-1a hash of each section.
+ *
+ * Saving is split in two:
+ * - captureSaveState() runs between ticks. It copies every section into a
+ *   SaveCapture. That copy is the copy-on-write step: the simulation goes
+ *   straight back to the live globals while the copy is handed over.
+ * - The save-writer thread owns the copy. It hashes each section and
+ *   writes only those whose hash changed since the last save. The sections
+ *   are synced to disk before the header is written, last.
+ *
+ * A save torn before its header lands leaves the previous save loadable.
+ * A full save (the first of a session, or after a level change) is written
+ * to a temp file and renamed over the old save once it is synced.
+ * A torn header fails its section hashes and the load rejects the file
+ * rather than loading a mix of two saves. Loading
+ * maps the whole file in one read, validates it and copies each section
+ * back into place.
+ *
+ * Save files are tied to the level they were made on (levelHash).
+ */
+typedef struct {
+    Uint32 offset;
+    Uint32 size;
+    Uint32 capacity;    // Bytes reserved at offset, and again at spare
+    Uint32 spare;       // The other slot; the next save of this section goes there
+    Uint64 hash;
+} SaveSectionEntry;
+
+typedef struct {
+    char magic[4];
+    Uint32 version;
+    Uint32 sectionCount;
+    Uint32 fileSize;    // End of the last reserved section
+    Uint64 levelHash;
+    SaveSectionEntry sections[SAVE_SECTION_COUNT];
+} SaveHeader;
+
+typedef struct {
+    float x, y, velocityX, velocityY, sprintEnergy;
+    Sint32 width, height;
+    Uint8 onGround, isSprinting, facingLeft, sprintKeyReleased, gameOver;
+} SavePlayer;
+
+typedef struct {
+    Uint32 simTickCount, simRngSeed, simRngState, lastShotTime;
+    Sint32 piwoCount;
+    Uint8 hasGun;
+    Uint8 shopPurchased[SHOP_ITEM_COUNT];
+} SaveWorld;
+
+// Rows rather than columns, so a bullet keeps its offset when the count changes
+typedef struct {
+    float x, y;         // First: rewind predicts these from vx and vy
+    float vx, vy, w, h;
+    Uint32 flags;
+} SaveBullet;
+
+typedef struct {
+    Uint8 isGambling, isShoppingOpen, isPaused, isSpinning, resultDisplayed, showError;
+    Uint8 aKeyPressed, bKeyPressed, escKeyPressed;
+    Sint32 currentBet, lastWinnings, spinResult;
+    Uint32 spinStartTime, resultStartTime, errorStartTime;
+    Sint32 betLength;
+    char betText[sizeof(((TextInput*)0)->text)];
+} SaveGambling;
+
+typedef struct {
+    char lines[DIALOG_MAX_LINES][DIALOG_LINE_MAX];
+    Sint32 totalLines, currentIndex;
+    Uint8 active, freezeMovement, portraitVisible, speakerVisible;
+    char portraitKey[CHARACTER_NAME_MAX];
+    char speaker[CHARACTER_NAME_MAX];
+} SaveDialog;
+
+// A frozen copy of every section, owned by the writer while a save is in flight
+typedef struct {
+    unsigned char* data[SAVE_SECTION_COUNT];
+    Uint32 size[SAVE_SECTION_COUNT];
+    Uint32 capacity[SAVE_SECTION_COUNT];
+    Uint64 levelHash;
+    Uint64 captureCounter;  // Performance counter ticks spent capturing
+} SaveCapture;
+
+// What the writer knows about a save file on disk
+typedef struct {
+    const char* path;
+    SaveHeader header;
+    bool valid;         // header matches the file, so the next save can be incremental
+} SaveFile;
+
+static SaveFile saveFile = { SAVE_STATE_PATH };
+static SaveCapture saveCapture = {0};
+static SDL_Thread* saveThread = NULL;
+static SDL_mutex* saveMutex = NULL;
+static SDL_cond* saveCond = NULL;      // Signals a queued capture and a finished write
+static bool saveBusy = false;          // saveCapture belongs to the writer until this clears
+static bool saveQuit = false;
+
+static Uint32 saveAlign(Uint32 size) {
+    return (size + (SAVE_SECTION_ALIGNMENT - 1)) & ~(Uint32)(SAVE_SECTION_ALIGNMENT - 1);
+}
+
+// Room for a section to grow by half before a save has to move it
+static Uint32 saveCapacity(Uint32 size) {
+    return saveAlign(size + size / 2 + SAVE_SECTION_ALIGNMENT);
+}
+
+// Size a section of the capture, zeroed so struct padding hashes the same every save
+static void* saveSection(SaveCapture* capture, int section, size_t size) {
+    if (size > capture->capacity[section]) {
+        Uint32 capacity = capture->capacity[section] ? capture->capacity[section] : 64;
+        while (capacity < size) capacity *= 2;
+        unsigned char* grown = realloc(capture->data[section], capacity);
+        if (!grown) return NULL;
+        capture->data[section] = grown;
+        capture->capacity[section] = capacity;
+    }
+    capture->size[section] = (Uint32)size;
+    if (size) memset(capture->data[section], 0, size);
+    return capture->data[section];
+}
+
+static void freeSaveCapture(SaveCapture* capture) {
+    for (int i = 0; i < SAVE_SECTION_COUNT; i++) free(capture->data[i]);
+    memset(capture, 0, sizeof(*capture));
+}
+
+// Copy the sections whose bits are set into capture; the others keep what they held
+static bool captureSaveSections(SaveCapture* capture, const Batarong* batarong, bool gameOver, Uint32 sections) {
+    if (sections & (1u << SAVE_PLAYER)) {
+        SavePlayer* player = saveSection(capture, SAVE_PLAYER, sizeof(SavePlayer));
+        if (!player) return false;
+        player->x = batarong->x;
+        player->y = batarong->y;
+        player->velocityX = batarong->velocityX;
+        player->velocityY = batarong->velocityY;
+        player->sprintEnergy = batarong->sprintEnergy;
+        player->width = batarong->width;
+        player->height = batarong->height;
+        player->onGround = batarong->onGround;
+        player->isSprinting = batarong->isSprinting;
+        player->facingLeft = batarong->facingLeft;
+        player->sprintKeyReleased = batarong->sprintKeyReleased;
+        player->gameOver = gameOver;
+    }
+
+    if (sections & (1u << SAVE_WORLD)) {
+        SaveWorld* world = saveSection(capture, SAVE_WORLD, sizeof(SaveWorld));
+        if (!world) return false;
+        world->simTickCount = simTickCount;
+        world->simRngSeed = simRngSeed;
+        world->simRngState = simRngState;
+        world->lastShotTime = lastShotTime;
+        world->piwoCount = piwoCount;
+        world->hasGun = hasGun;
+        for (int i = 0; i < SHOP_ITEM_COUNT; i++) world->shopPurchased[i] = shopItems[i].purchased;
+    }
+
+    if (sections & (1u << SAVE_GAMBLING)) {
+        SaveGambling* gambling = saveSection(capture, SAVE_GAMBLING, sizeof(SaveGambling));
+        if (!gambling) return false;
+        gambling->isGambling = isGambling;
+        gambling->isShoppingOpen = isShoppingOpen;
+        gambling->isPaused = isPaused;
+        gambling->isSpinning = isSpinning;
+        gambling->resultDisplayed = resultDisplayed;
+        gambling->showError = showError;
+        gambling->aKeyPressed = aKeyPressed;
+        gambling->bKeyPressed = bKeyPressed;
+        gambling->escKeyPressed = escKeyPressed;
+        gambling->currentBet = currentBet;
+        gambling->lastWinnings = lastWinnings;
+        gambling->spinResult = spinResult;
+        gambling->spinStartTime = spinStartTime;
+        gambling->resultStartTime = resultStartTime;
+        gambling->errorStartTime = errorStartTime;
+        gambling->betLength = betInput.length;
+        memcpy(gambling->betText, betInput.text, sizeof(gambling->betText));
+    }
+
+    if (sections & (1u << SAVE_DIALOG)) {
+        SaveDialog* dialog = saveSection(capture, SAVE_DIALOG, sizeof(SaveDialog));
+        if (!dialog) return false;
+        memcpy(dialog->lines, dialogState.lines, sizeof(dialog->lines));
+        dialog->totalLines = dialogState.totalLines;
+        dialog->currentIndex = dialogState.currentIndex;
+        dialog->active = dialogState.active;
+        dialog->freezeMovement = dialogState.freeze_movement;
+        dialog->portraitVisible = dialogState.portrait_visible;
+        dialog->speakerVisible = dialogState.speaker_visible;
+        memcpy(dialog->portraitKey, dialogState.portraitKey, sizeof(dialog->portraitKey));
+        memcpy(dialog->speaker, dialogState.speaker, sizeof(dialog->speaker));
+    }
+
+    if (sections & (1u << SAVE_PIWO)) {
+        Uint8* piwo = saveSection(capture, SAVE_PIWO, sizeof(bool) * (size_t)piwoListCount);
+        if (!piwo && piwoListCount > 0) return false;
+        if (piwoListCount > 0) memcpy(piwo, piwoCollected, sizeof(bool) * (size_t)piwoListCount);
+    }
+
+    if (sections & (1u << SAVE_BULLETS)) {
+        size_t rows = (size_t)bulletStore.count;
+        Uint32* bullets = saveSection(capture, SAVE_BULLETS, sizeof(Uint32) + sizeof(SaveBullet) * rows);
+        if (!bullets) return false;
+        bullets[0] = (Uint32)rows;
+        SaveBullet* bullet = (SaveBullet*)(bullets + 1);
+        for (size_t r = 0; r < rows; r++) {
+            bullet[r] = (SaveBullet){ bulletStore.x[r], bulletStore.y[r], bulletStore.vx[r], bulletStore.vy[r],
+                                      bulletStore.w[r], bulletStore.h[r], bulletStore.flags[r] };
+        }
+    }
+    return true;
+}
+
+// Copy the whole game state into capture; the only part of a save that runs on the main thread
+static bool captureSaveState(SaveCapture* capture, const Batarong* batarong, bool gameOver) {
+    capture->levelHash = levelFileHash();  // Hashed once per level, so left out of the timing
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (!captureSaveSections(capture, batarong, gameOver, SAVE_ALL_SECTIONS)) {
+        printf("Out of memory capturing save state\n");
+        return false;
+    }
+    capture->captureCounter = SDL_GetPerformanceCounter() - start;
+    return true;
+}
+
+// Push everything written so far to the disk, so later writes can't land before it
+static bool syncSaveFile(FILE* out) {
+    if (fflush(out) != 0) return false;
+#ifdef HAVE_MMAP
+    if (fsync(fileno(out)) != 0) return false;
+#endif
+    return true;
+}
+
+// Write the sections of capture that differ from what file already holds (all of
+// them the first time). Returns how many were written, or -1 on error.
+static int writeSaveFile(SaveFile* file, const SaveCapture* capture) {
+    SaveHeader header = file->header;
+    bool full = !file->valid || header.levelHash != capture->levelHash;
+    if (full) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SAVE_STATE_MAGIC, 4);
+        header.version = SAVE_STATE_VERSION;
+        header.sectionCount = SAVE_SECTION_COUNT;
+        header.levelHash = capture->levelHash;
+        header.fileSize = saveAlign((Uint32)sizeof(header));
+    }
+    bool dirty[SAVE_SECTION_COUNT];
+    int dirtyCount = 0;
+    for (int i = 0; i < SAVE_SECTION_COUNT; i++) {
+        SaveSectionEntry* entry = &header.sections[i];
+        Uint64 hash = hashBytes(capture->data[i], capture->size[i]);
+        dirty[i] = full || entry->hash != hash || entry->size != capture->size[i];
+        if (!dirty[i]) continue;
+        if (full || capture->size[i] > entry->capacity) {
+            // New pair of slots at the end; the old ones are abandoned
+            if ((Uint64)header.fileSize + 2ull * saveCapacity(capture->size[i]) > UINT32_MAX) return -1;
+            entry->capacity = saveCapacity(capture->size[i]);
+            entry->offset = header.fileSize;
+            entry->spare = entry->offset + entry->capacity;
+            header.fileSize = entry->spare + entry->capacity;
+        } else {
+            // Write into the spare slot; the live copy stays intact until the header moves
+            Uint32 live = entry->offset;
+            entry->offset = entry->spare;
+            entry->spare = live;
+        }
+        entry->size = capture->size[i];
+        entry->hash = hash;
+        dirtyCount++;
+    }
+    if (dirtyCount == 0) return 0;
+
+    // A full save goes to a temp file renamed over the old save once it is complete,
+    // so the previous session's save survives a crash in the middle
+    char tempPath[FILENAME_MAX];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", file->path);
+    FILE* out = fopen(full ? tempPath : file->path, full ? "wb" : "r+b");
+    if (!out) {
+        if (full) {
+            printf("Error opening save file: %s\n", tempPath);
+            return -1;
+        }
+        file->valid = false;  // Deleted behind our back: start over
+        return writeSaveFile(file, capture);
+    }
+    bool ok = true;
+    for (int i = 0; i < SAVE_SECTION_COUNT && ok; i++) {
+        if (!dirty[i] || capture->size[i] == 0) continue;
+        ok = fseek(out, (long)header.sections[i].offset, SEEK_SET) == 0 &&
+             fwrite(capture->data[i], 1, capture->size[i], out) == capture->size[i];
+    }
+    // The sections must be on disk before a header that points at them
+    ok = ok && syncSaveFile(out);
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1 && syncSaveFile(out);
+    if (fclose(out) != 0) ok = false;
+    if (ok && full && rename(tempPath, file->path) != 0) {
+        remove(file->path);  // Platforms where rename() won't replace; the new save is complete by now
+        if (rename(tempPath, file->path) != 0) {
+            printf("Error replacing save file %s; the save is in %s\n", file->path, tempPath);
+            file->valid = false;
+            return -1;
+        }
+    }
+    if (!ok) {
+        if (full) remove(tempPath);
+        printf("Error writing save file: %s\n", file->path);
+        file->valid = false;
+        return -1;
+    }
+    file->header = header;
+    file->valid = true;
+    return dirtyCount;
+}
 
-            // Block movement when dialog requests freeze
-            if (!dialogState.active || !dialogState.freeze_movement) {
-                if (state[SDL_SCANCODE_UP]) {
-                    if (batarong->onGround) {
-                        batarong->velocityY = JUMP_FORCE; // Jump if on the ground
-                        batarong->onGround = false;
-                    }
-                }
-                if (state[SDL_SCANCODE_LEFT]) {
-                    batarong->x -= currentSpeed; // Move left
-                    batarong->facingLeft = true;  // Update direction
-                }
-                if (state[SDL_SCANCODE_RIGHT]) {
-                    batarong->x += currentSpeed; // Move right
-                    batarong->facingLeft = false;  // Update direction
-                }
-            }
+static int saveWorker(void* data) {
+    (void)data;
+    TRACE_THREAD("save-writer");
+    SDL_LockMutex(saveMutex);
+    while (!saveQuit) {
+        if (!saveBusy) {
+            SDL_CondWait(saveCond, saveMutex);
+            continue;
         }
+        SDL_UnlockMutex(saveMutex);
+        Uint64 start = SDL_GetPerformanceCounter();
+        int written;
+        TRACE_BEGIN("writeSaveFile");
+        written = writeSaveFile(&saveFile, &saveCapture);
+        TRACE_END("writeSaveFile");
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        if (written >= 0) {
+            printf("Saved %s: %d/%d sections written, capture %.3f ms, write %.3f ms\n", saveFile.path, written,
+                   SAVE_SECTION_COUNT, (double)saveCapture.captureCounter * 1000.0 / frequency,
+                   (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency);
+        }
+        SDL_LockMutex(saveMutex);
+        saveBusy = false;
+        SDL_CondBroadcast(saveCond);
+    }
+    SDL_UnlockMutex(saveMutex);
+    return 0;
+}
 
-        // Add number key handling for shop purchases
-        if (isShoppingOpen) {
-            if (state[SDL_SCANCODE_1] || state[SDL_SCANCODE_2] || state[SDL_SCANCODE_3]) {
-                int itemIndex = -1;
-                if (state[SDL_SCANCODE_1]) itemIndex = 0;
-                if (state[SDL_SCANCODE_2]) itemIndex = 1;
-                if (state[SDL_SCANCODE_3]) itemIndex = 2;
+// Block until no save is in flight
+static void waitForSave(void) {
+    if (!saveThread) return;
+    SDL_LockMutex(saveMutex);
+    while (saveBusy) SDL_CondWait(saveCond, saveMutex);
+    SDL_UnlockMutex(saveMutex);
+}
 
-                if (itemIndex >= 0 && !shopItems[itemIndex].purchased) {
-                    if (piwoCount >= shopItems[itemIndex].price) {
-                        piwoCount -= shopItems[itemIndex].price;
-                        shopItems[itemIndex].purchased = true;
-                        // Give player the gun when purchasing first item (pistol)
-                        if (itemIndex == 0) {
-                            hasGun = true;
-                        }
-                    }
-                }
-            }
+// Capture now and hand the copy to the writer. Returns false if the previous
+// save is still being written; try again next frame.
+static bool requestSaveState(const Batarong* batarong, bool gameOver) {
+    if (!saveThread && !saveMutex) {
+        saveMutex = SDL_CreateMutex();
+        saveCond = SDL_CreateCond();
+        if (saveMutex && saveCond) saveThread = SDL_CreateThread(saveWorker, "save-writer", NULL);
+        if (!saveThread) printf("Save writer thread unavailable, saving inline: %s\n", SDL_GetError());
+    }
+    if (!saveThread) {
+        if (captureSaveState(&saveCapture, batarong, gameOver) && writeSaveFile(&saveFile, &saveCapture) >= 0) {
+            printf("Saved %s\n", saveFile.path);
         }
+        return true;
+    }
+    SDL_LockMutex(saveMutex);
+    bool busy = saveBusy;
+    SDL_UnlockMutex(saveMutex);
+    if (busy) return false;
+    bool captured;
+    TRACE("captureSaveState", captured = captureSaveState(&saveCapture, batarong, gameOver));
+    if (!captured) return true;
+    SDL_LockMutex(saveMutex);
+    saveBusy = true;
+    SDL_CondBroadcast(saveCond);
+    SDL_UnlockMutex(saveMutex);
+    return true;
+}
 
-    } else {
-        // Update the restart logic in handleInput function
-        if (state[SDL_SCANCODE_R]) {
-            *gameOver = false; // Reset game over state
-            batarong->x = 300; // Reset player position
-            batarong->y = 400; // Reset player position
-            batarong->velocityY = 0; // Reset vertical velocity
-            batarong->onGround = true; // Reset on ground status
-            batarong->sprintEnergy = MAX_SPRINT_ENERGY;  // Reset sprint energy to full
-            batarong->isSprinting = false;  // Reset sprint state
-            batarong->sprintKeyReleased = true;  // Reset sprint key state
-            // Remove piwo reset
-            // piwoCount = 0; // Remove this line
-            // Remove piwo collectibles reset
-            for (int i = 0; i < MAX_PIWO; i++) {
-                if (!piwoList[i].collected) {
-                    piwoList[i].collected = false; // Only reset uncollected piwo
-                }
-            }
-            // Don't reset gun status
-            // hasGun = false; // Remove this line if it exists
-        }
+static void stopSaveWriter(void) {
+    if (saveThread) {
+        SDL_LockMutex(saveMutex);
+        saveQuit = true;  // The writer finishes a save in flight before it sees this
+        SDL_CondBroadcast(saveCond);
+        SDL_UnlockMutex(saveMutex);
+        SDL_WaitThread(saveThread, NULL);
+        saveThread = NULL;
     }
+    if (saveCond) SDL_DestroyCond(saveCond);
+    if (saveMutex) SDL_DestroyMutex(saveMutex);
+    saveCond = NULL;
+    saveMutex = NULL;
+    saveQuit = saveBusy = false;
+    freeSaveCapture(&saveCapture);
+}
 
-    // Shooting control (reuses fetched state)
-    if (!*gameOver && !isGambling && !isShoppingOpen && !isPaused) {
-        if (state[SDL_SCANCODE_SPACE] && hasGun) {
-            shootBullet(batarong);
+// Check a mapped save file against this level and build; prints why if it can't be loaded
+static bool validateSaveFile(const MemoryFile* file, SaveHeader* header) {
+    if (file->size < sizeof(*header)) return false;
+    memcpy(header, file->data, sizeof(*header));
+    if (memcmp(header->magic, SAVE_STATE_MAGIC, 4) != 0 || header->sectionCount != SAVE_SECTION_COUNT) return false;
+    if (header->version != SAVE_STATE_VERSION) {
+        printf("Save state version %u is not supported (expected %d)\n", header->version, SAVE_STATE_VERSION);
+        return false;
+    }
+    if (header->levelHash != levelFileHash()) {
+        printf("Save state was made on a different level\n");
+        return false;
+    }
+    const unsigned char* base = (const unsigned char*)file->data;
+    for (int i = 0; i < SAVE_SECTION_COUNT; i++) {
+        const SaveSectionEntry* entry = &header->sections[i];
+        if ((Uint64)entry->offset + entry->size > file->size ||
+            hashBytes(base + entry->offset, entry->size) != entry->hash) {
+            printf("Save state is damaged (section %d)\n", i);
+            return false;
         }
     }
+    return true;
 }
 
-void applyGravity(Batarong* batarong) {
-    if (!batarong->onGround) {
-        batarong->velocityY += GRAVITY; // Apply gravity
-        batarong->y += batarong->velocityY; // Update player position
+// Section sizes must match this build and level, and bullets its own row count.
+static bool saveSectionsValid(const unsigned char* const data[SAVE_SECTION_COUNT], const Uint32 size[SAVE_SECTION_COUNT]) {
+    if (size[SAVE_PLAYER] != sizeof(SavePlayer) || size[SAVE_WORLD] != sizeof(SaveWorld) ||
+        size[SAVE_GAMBLING] != sizeof(SaveGambling) || size[SAVE_DIALOG] != sizeof(SaveDialog) ||
+        size[SAVE_PIWO] != sizeof(bool) * (size_t)piwoListCount || size[SAVE_BULLETS] < sizeof(Uint32)) return false;
+    Uint32 rows;
+    memcpy(&rows, data[SAVE_BULLETS], sizeof(rows));
+    return size[SAVE_BULLETS] == sizeof(Uint32) + sizeof(SaveBullet) * (Uint64)rows;
+}
+
+// Replace the running game with validated sections (from a save file or the rewind buffer)
+static void applySaveSections(const unsigned char* const data[SAVE_SECTION_COUNT], Batarong* batarong, bool* gameOver,
+                              SDL_Renderer* renderer) {
+    SavePlayer player;
+    SaveWorld world;
+    SaveGambling gambling;
+    memcpy(&player, data[SAVE_PLAYER], sizeof(player));
+    memcpy(&world, data[SAVE_WORLD], sizeof(world));
+    memcpy(&gambling, data[SAVE_GAMBLING], sizeof(gambling));
+
+    batarong->x = batarong->prevX = player.x;
+    batarong->y = batarong->prevY = player.y;
+    batarong->velocityX = player.velocityX;
+    batarong->velocityY = player.velocityY;
+    batarong->sprintEnergy = player.sprintEnergy;
+    batarong->width = player.width;
+    batarong->height = player.height;
+    batarong->onGround = player.onGround;
+    batarong->isSprinting = player.isSprinting;
+    batarong->facingLeft = player.facingLeft;
+    batarong->sprintKeyReleased = player.sprintKeyReleased;
+    *gameOver = player.gameOver;
+
+    simTickCount = world.simTickCount;
+    simRngSeed = world.simRngSeed;
+    simRngState = world.simRngState;
+    lastShotTime = world.lastShotTime;
+    piwoCount = world.piwoCount;
+    hasGun = world.hasGun;
+    for (int i = 0; i < SHOP_ITEM_COUNT; i++) shopItems[i].purchased = world.shopPurchased[i];
+
+    if (piwoListCount > 0) memcpy(piwoCollected, data[SAVE_PIWO], sizeof(bool) * (size_t)piwoListCount);
+
+    // Bullets come back as fresh rows; nothing holds bullet handles across a load
+    const unsigned char* bullets = data[SAVE_BULLETS];
+    Uint32 rows;
+    memcpy(&rows, bullets, sizeof(rows));
+    clearEntityStore(&bulletStore);
+    for (Uint32 r = 0; r < rows; r++) {
+        SaveBullet bullet;
+        memcpy(&bullet, bullets + sizeof(Uint32) + sizeof(SaveBullet) * (size_t)r, sizeof(bullet));
+        int row = entityRow(&bulletStore, spawnEntity(&bulletStore, bullet.x, bullet.y, bullet.w, bullet.h));
+        if (row < 0) break;
+        bulletStore.vx[row] = bullet.vx;
+        bulletStore.vy[row] = bullet.vy;
+        bulletStore.flags[row] = bullet.flags;
+    }
+
+    isGambling = gambling.isGambling;
+    isShoppingOpen = gambling.isShoppingOpen;
+    isPaused = gambling.isPaused;
+    isSpinning = gambling.isSpinning;
+    resultDisplayed = gambling.resultDisplayed;
+    showError = gambling.showError;
+    aKeyPressed = gambling.aKeyPressed;
+    bKeyPressed = gambling.bKeyPressed;
+    escKeyPressed = gambling.escKeyPressed;
+    currentBet = gambling.currentBet;
+    lastWinnings = gambling.lastWinnings;
+    spinResult = gambling.spinResult;
+    spinStartTime = gambling.spinStartTime;
+    resultStartTime = gambling.resultStartTime;
+    errorStartTime = gambling.errorStartTime;
+    betInput.length = gambling.betLength >= 0 && gambling.betLength <= betInput.maxLength ? gambling.betLength : 0;
+    memcpy(betInput.text, gambling.betText, sizeof(betInput.text));
+    betInput.text[betInput.length] = '\0';
+
+    SaveDialog dialog;
+    memcpy(&dialog, data[SAVE_DIALOG], sizeof(dialog));
+    dialog_close();
+    memcpy(dialogState.lines, dialog.lines, sizeof(dialogState.lines));
+    for (int i = 0; i < DIALOG_MAX_LINES; i++) dialogState.lines[i][DIALOG_LINE_MAX - 1] = '\0';
+    dialogState.totalLines = dialog.totalLines >= 0 && dialog.totalLines <= DIALOG_MAX_LINES ? dialog.totalLines : 0;
+    dialogState.currentIndex = dialog.currentIndex;
+    dialogState.active = dialog.active && dialog.currentIndex >= 0 && dialog.currentIndex < dialogState.totalLines;
+    dialogState.freeze_movement = dialog.freezeMovement;
+    dialogState.portrait_visible = dialog.portraitVisible;
+    dialogState.speaker_visible = dialog.speakerVisible;
+    // Whole arrays, so bytes past the terminator match the capture too
+    memcpy(dialogState.portraitKey, dialog.portraitKey, CHARACTER_NAME_MAX);
+    memcpy(dialogState.speaker, dialog.speaker, CHARACTER_NAME_MAX);
+    dialogState.portraitKey[CHARACTER_NAME_MAX - 1] = dialogState.speaker[CHARACTER_NAME_MAX - 1] = '\0';
+    if (dialogState.active && dialogState.portrait_visible && dialogState.portraitKey[0] && renderer) {
+        dialogState.portrait = acquireSprite(renderer, dialogState.portraitKey, "images/batarong.bmp");
     }
+
+    // Derived state follows from what was loaded
+    saveDirtySections = SAVE_ALL_SECTIONS;
+    currentRay = -1;
+    scanPlayerOverlaps(batarong, false);
+    simCameraX = (int)batarong->x - (800 / 2);
+    updateWorldStreaming(simCameraX, batarong->facingLeft);
 }
 
-bool checkCollision(Batarong* batarong, bool* gameOver) {
-    // Reset onGround status
-    batarong->onGround = false;
-    // Precompute predicted next Y once per frame (saves repeated arithmetic inside loop)
-    int nextYPred = batarong->y + batarong->velocityY + GRAVITY;
-    for (int i = 0; i < platformCount; i++) {
-        if (batarong->x < platforms[i].x + PLATFORM_WIDTH &&
-            batarong->x + batarong->width > platforms[i].x &&
-            nextYPred + batarong->height >= platforms[i].y &&
-            nextYPred <= platforms[i].y + PLATFORM_HEIGHT) {
-            batarong->y = platforms[i].y - batarong->height;
-            batarong->onGround = true;
-            batarong->velocityY = 0;
-            break; // Early out after landing
+// Replace the running game with the save in file->path. The writer must be idle.
+static bool loadSaveFile(SaveFile* saveTarget, Batarong* batarong, bool* gameOver, SDL_Renderer* renderer) {
+    MemoryFile file = {0};
+    if (mapFileToMemory(saveTarget->path, &file) != 0) {
+        printf("No save state to load: %s\n", saveTarget->path);
+        return false;
+    }
+    SaveHeader header;
+    const unsigned char* data[SAVE_SECTION_COUNT];
+    Uint32 size[SAVE_SECTION_COUNT];
+    bool valid = validateSaveFile(&file, &header);
+    if (valid) {
+        for (int i = 0; i < SAVE_SECTION_COUNT; i++) {
+            data[i] = (const unsigned char*)file.data + header.sections[i].offset;
+            size[i] = header.sections[i].size;
         }
+        valid = saveSectionsValid(data, size);
+    }
+    if (!valid) {
+        printf("Unable to load save state: %s\n", saveTarget->path);
+        releaseMemoryFile(&file);
+        return false;
     }
+    applySaveSections(data, batarong, gameOver, renderer);
+    releaseMemoryFile(&file);
 
-    // Check if the player has fallen below the bottom of the window
-    if (batarong->y > WINDOW_HEIGHT) {
-        *gameOver = true; // Set game over state
+    // The file is exactly what the writer would have left, so the next save stays incremental
+    saveTarget->header = header;
+    saveTarget->valid = true;
+    return true;
+}
+
+static bool loadSaveState(Batarong* batarong, bool* gameOver, SDL_Renderer* renderer) {
+    if (inputReplay.recording || inputReplay.replaying) {
+        printf("Save states can't be loaded while recording or replaying input\n");
+        return false;
+    }
+    waitForSave();
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool loaded;
+    TRACE("loadSaveFile", loaded = loadSaveFile(&saveFile, batarong, gameOver, renderer));
+    if (loaded) {
+        printf("Loaded %s in %.3f ms\n", saveFile.path,
+               (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency());
     }
+    return loaded;
+}
 
-    // Check for collision with piwo
-    for (int i = 0; i < MAX_PIWO; i++) {
-        if (!piwoList[i].collected && 
-            batarong->x < piwoList[i].x + 32 && // Assuming piwo width is 32
-            batarong->x + batarong->width > piwoList[i].x &&
-            batarong->y < piwoList[i].y + 32 && // Assuming piwo height is 32
-            batarong->y + batarong->height > piwoList[i].y) {
-            // Collision detected with piwo
-            piwoList[i].collected = true; // Mark piwo as collected
-            piwoCount++; // Increment the piwo counter
-        }
+/*
+ * Rewind. After every tick the windowed loop pushes the simulation state
+ * into a ring of deltas. The state is every save-state section, the
+ * dialog included since an open one can freeze movement, laid out as one
+ * image: the section sizes, then each section padded to 8 bytes.
+ *
+ * A delta is the new image XORed with the previous one, run-length encoded
+ * as repeated varint pairs (equal bytes, changed bytes), each pair followed
+ * by the changed bytes. Unchanged state XORs to zero, so a quiet tick
+ * costs a few bytes. A push only captures, stages and XORs the sections in
+ * saveDirtySections plus SAVE_TICK_SECTIONS; the rest are counted as equal
+ * without being read, so its cost follows what changed, not the level size.
+ * Bullet positions are XORed against where each bullet
+ * was a tick earlier (position minus velocity) instead, so bullets in
+ * flight cost nothing either; only spawns, removals and the rows they move
+ * do.
+ *
+ * Holding rewind pops the newest delta and XORs it back into the current
+ * image. That yields the tick before, which applySaveSections() loads. The
+ * oldest deltas fall off when the REWIND_BUFFER_BYTES ring or the
+ * REWIND_MAX_TICKS index fills, so heavy churn shortens the window; the
+ * rewind benchmark's "s kept" column shows by how much.
+ *
+ * Nothing allocates per tick. The buffers only grow when the state gets
+ * bigger than it has ever been, e.g. more bullets than before.
+ *
+ * rewindTicks() doubles as the rollback primitive: step back n ticks, then
+ * run simulateTick() forward again with corrected input.
+ */
+typedef struct {
+    Uint32 offset;      // Start of the encoded delta in the byte ring
+    Uint32 size;        // Encoded bytes
+    Uint32 imageSize;   // Size of the image this delta restores
+} RewindEntry;
+
+typedef struct {
+    unsigned char* ring;            // REWIND_BUFFER_BYTES of encoded deltas, oldest first
+    Uint32 ringHead, ringUsed;      // Next write position; bytes in use, ending at ringHead
+    RewindEntry entries[REWIND_MAX_TICKS];
+    int first, count;               // Oldest live entry; live entries
+    unsigned char* image;           // The current state; zero past imageSize
+    unsigned char* next;            // Sections from the first one that changed size, staged at their new offsets
+    unsigned char* delta;           // Encode scratch, and a popped delta unwrapped from the ring
+    Uint32 imageSize, imageCapacity, deltaCapacity;
+    bool primed;                    // image holds a pushed state
+    SaveCapture capture;            // Sections not captured since keep their last copy
+} RewindBuffer;
+
+static RewindBuffer rewindBuffer = {0};
+
+static Uint32 putVarint(unsigned char* out, Uint32 value) {
+    Uint32 n = 0;
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
     }
+    out[n++] = (unsigned char)value;
+    return n;
+}
 
-    return batarong->onGround;
+static Uint32 getVarint(const unsigned char* in, Uint32* position) {
+    Uint32 value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        unsigned char byte = in[(*position)++];
+        value |= (Uint32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
 }
 
-void renderPlatforms(SDL_Renderer* renderer) {
-    for (int i = 0; i < platformCount; i++) {
-        SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); // Green color for platforms
-        // Adjust platform position based on camera
-        SDL_Rect platformRect = { platforms[i].x - cameraX, platforms[i].y, PLATFORM_WIDTH, PLATFORM_HEIGHT };
-        SDL_RenderFillRect(renderer, &platformRect); // Draw the platform
+#ifdef HAVE_SSE2
+static inline Uint32 changedBytes16(const unsigned char* a, const unsigned char* b) {
+    __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+    return ~(Uint32)_mm_movemask_epi8(equal) & 0xFFFF;
+}
+#endif
+
+// Bit k set where a[k] != b[k], for the first n <= 64 bytes; the before bytes ahead of a and b are readable too
+static inline Uint64 changedByteMask(const unsigned char* a, const unsigned char* b, Uint32 n, Uint32 before) {
+    Uint64 bits = 0;
+    Uint32 k = 0;
+#ifdef HAVE_SSE2
+    for (; k + 16 <= n; k += 16) bits |= (Uint64)changedBytes16(a + k, b + k) << k;
+    if (k < n && before + n >= 16) {
+        // Overlap the last 16 bytes rather than finish byte by byte
+        bits |= (Uint64)(changedBytes16(a + n - 16, b + n - 16) >> (16 - (n - k))) << k;
+        k = n;
+    }
+#endif
+    for (; k + 8 <= n; k += 8) {
+        Uint64 x, y;
+        memcpy(&x, a + k, 8);
+        memcpy(&y, b + k, 8);
+        if (x == y) continue;
+        for (Uint32 j = k; j < k + 8; j++) bits |= (Uint64)(a[j] != b[j]) << j;
     }
+    for (; k < n; k++) bits |= (Uint64)(a[k] != b[k]) << k;
+    return bits;
 }
 
-void renderPiwo(SDL_Renderer* renderer) {
-    for (int i = 0; i < MAX_PIWO; i++) {
-        if (!piwoList[i].collected) {
-            SDL_Rect piwoRect = { piwoList[i].x - cameraX, piwoList[i].y, 32, 32 }; // Adjust position based on camera
-            SDL_RenderCopy(renderer, piwoList[i].texture, NULL, &piwoRect); // Draw the piwo texture
-        }
+// One (equal, changed) pair of a delta for next[start..end), copied over image
+static Uint32 putRewindRun(unsigned char* restrict image, const unsigned char* restrict next, Uint32 start, Uint32 end,
+                           unsigned char* restrict out, Uint32* same) {
+    Uint32 o = putVarint(out, *same);
+    o += putVarint(out + o, end - start);
+    for (Uint32 k = start; k < end; k++) {
+        out[o++] = image[k] ^ next[k];
+        image[k] = next[k];
     }
+    *same = 0;
+    return o;
 }
 
-void renderText(SDL_Renderer* renderer, TTF_Font* font, const char* text, SDL_Color color, int x, int y) {
-    SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, color);
-    if (textSurface) {
-        SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-        SDL_Rect textRect = { x, y, textSurface->w, textSurface->h };
-        SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-        SDL_DestroyTexture(textTexture);
-        SDL_FreeSurface(textSurface);
+// XOR + RLE of next against n bytes of image, appended at out, leaving next copied over image.
+// Runs are found from a mask of changed bytes 64 at a time. *same carries the equal bytes
+// not written yet across calls, so skipped regions just add to it. Out needs 3n/2 + 10 bytes.
+static Uint32 encodeRewindDelta(unsigned char* restrict image, const unsigned char* restrict next, Uint32 n,
+                                unsigned char* restrict out, Uint32* same) {
+    Uint32 o = 0, run = n;  // Start of the changed run being scanned; n between runs
+    for (Uint32 base = 0; base < n; base += 64) {
+        Uint32 length = n - base < 64 ? n - base : 64;
+        Uint64 bits = changedByteMask(image + base, next + base, length, base);
+        // Gaps of one or two equal bytes cost no more than the pair that would restart the run
+        bits |= ((bits << 1) & (bits >> 1)) | ((bits << 1) & (bits >> 2)) | ((bits << 2) & (bits >> 1));
+        Uint32 k = 0;
+        while (k < length) {
+            if (run == n) {
+                Uint64 rest = bits >> k;
+                if (!rest) {
+                    *same += length - k;
+                    break;
+                }
+                Uint32 skip = (Uint32)__builtin_ctzll(rest);
+                *same += skip;
+                k += skip;
+                run = base + k;
+            } else {
+                // Bits past a short last block read as equal, ending the run there
+                Uint64 rest = ~bits >> k;
+                if (!rest) break;
+                k += (Uint32)__builtin_ctzll(rest);
+                o += putRewindRun(image, next, run, base + k, out + o, same);
+                run = n;
+            }
+        }
     }
+    if (run != n) o += putRewindRun(image, next, run, n, out + o, same);
+    return o;
 }
 
-void renderGameOver(SDL_Renderer* renderer, TTF_Font* font) {
-    // Fill the entire screen with black
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_Rect fullscreenRect = { 0, 0, 800, 600 };
-    SDL_RenderFillRect(renderer, &fullscreenRect);
+static void applyRewindDelta(unsigned char* restrict image, const unsigned char* restrict delta, Uint32 size) {
+    Uint32 i = 0, o = 0;
+    while (o < size) {
+        i += getVarint(delta, &o);
+        Uint32 changed = getVarint(delta, &o);
+        for (Uint32 k = 0; k < changed; k++) image[i++] ^= delta[o++];
+    }
+}
 
-    // Center the "Game Over" text
-    SDL_Color textColor = { 255, 255, 255 }; // White color for text
-    renderText(renderer, font, "Game Over", textColor, 300, 250);
+// Offset of each section in an image with these section sizes; returns the image size
+static Uint32 rewindLayout(const Uint32 size[SAVE_SECTION_COUNT], Uint32 offset[SAVE_SECTION_COUNT]) {
+    Uint32 end = sizeof(Uint32) * SAVE_SECTION_COUNT;
+    for (int i = 0; i < SAVE_SECTION_COUNT; i++) {
+        offset[i] = end;
+        end += (size[i] + 7) & ~7u;
+    }
+    return end;
+}
 
-    // Center the "Press R to Restart" text
-    renderText(renderer, font, "Press R to Restart", textColor, 270, 300);
+// Point data[] into an image; false if its layout doesn't fit its size
+static bool readRewindImage(const unsigned char* image, Uint32 imageSize, const unsigned char* data[SAVE_SECTION_COUNT],
+                            Uint32 size[SAVE_SECTION_COUNT]) {
+    memcpy(size, image, sizeof(Uint32) * SAVE_SECTION_COUNT);
+    Uint64 offset = sizeof(Uint32) * SAVE_SECTION_COUNT;
+    for (int i = 0; i < SAVE_SECTION_COUNT; i++) {
+        data[i] = image + offset;
+        offset += (size[i] + 7) & ~7u;
+    }
+    return offset == imageSize;
+}
 
-    // Add piwo count to the game over screen
-    char scoreText[32];
-    sprintf(scoreText, "piwo count: %d", piwoCount);
-    renderText(renderer, font, scoreText, textColor, 300, 350);
+// XOR into target, at each bullet position of the bullet section at bullets, that position
+// XOR the position integrateEntities() moved it from. Applied to the previous image before
+// encoding, and to the current image in place before decoding.
+static void xorBulletPrediction(const unsigned char* bullets, unsigned char* target) {
+    Uint32 rows;
+    memcpy(&rows, bullets, sizeof(rows));
+    for (Uint32 r = 0; r < rows; r++) {
+        const size_t row = sizeof(Uint32) + sizeof(SaveBullet) * (size_t)r;
+        // Just the fields used; copying the whole row stalls on reading it back in pieces
+        float position[2], velocity[2];
+        memcpy(position, bullets + row + offsetof(SaveBullet, x), sizeof(position));
+        memcpy(velocity, bullets + row + offsetof(SaveBullet, vx), sizeof(velocity));
+        const float predicted[2] = { position[0] - velocity[0], position[1] - velocity[1] };
+        Uint32 actualBits[2], predictedBits[2], bits[2];
+        memcpy(actualBits, position, sizeof(actualBits));
+        memcpy(predictedBits, predicted, sizeof(predictedBits));
+        memcpy(bits, target + row, sizeof(bits));
+        bits[0] ^= actualBits[0] ^ predictedBits[0];
+        bits[1] ^= actualBits[1] ^ predictedBits[1];
+        memcpy(target + row, bits, sizeof(bits));
+    }
 }
 
-void renderPauseScreen(SDL_Renderer* renderer, TTF_Font* font) {
-    // Dim screen with semi-transparent overlay (simulate by drawing a dark rectangle)
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
-    SDL_Rect overlay = {0, 0, 800, 600};
-    SDL_RenderFillRect(renderer, &overlay);
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+// Grow the image buffers (zero-filled) to hold size bytes; only when state outgrows every earlier tick
+static bool reserveRewindImage(RewindBuffer* rewind, Uint32 size) {
+    if (size <= rewind->imageCapacity) return true;
+    Uint32 capacity = rewind->imageCapacity ? rewind->imageCapacity : 4096;
+    while (capacity < size) capacity *= 2;
+    unsigned char* image = realloc(rewind->image, capacity);
+    if (image) rewind->image = image;
+    unsigned char* next = realloc(rewind->next, capacity);
+    if (next) rewind->next = next;
+    // Each encoded region may add a carried varint pair on top of 3n/2
+    Uint32 deltaCapacity = capacity * 3 / 2 + 16 * (SAVE_SECTION_COUNT + 2);
+    unsigned char* delta = realloc(rewind->delta, deltaCapacity);
+    if (delta) rewind->delta = delta;
+    if (!image || !next || !delta) return false;
+    memset(rewind->image + rewind->imageCapacity, 0, capacity - rewind->imageCapacity);
+    rewind->imageCapacity = capacity;
+    rewind->deltaCapacity = deltaCapacity;
+    return true;
+}
 
-    SDL_Color textColor = {255, 255, 255};
-    renderText(renderer, font, "Paused", textColor, 360, 240);
-    renderText(renderer, font, "Press ESC to Resume", textColor, 300, 280);
+static void clearRewind(void) {
+    rewindBuffer.first = rewindBuffer.count = 0;
+    rewindBuffer.ringHead = rewindBuffer.ringUsed = 0;
+    rewindBuffer.primed = false;
 }
 
-// Modify renderSprintBar function to show shop prompt when near Ray
-void renderSprintBar(SDL_Renderer* renderer, float sprintEnergy, Batarong* batarong, TTF_Font* font) {
-    // Draw sprint bar background
-    SDL_SetRenderDrawColor(renderer, 100, 100, 100, 255);
-    SDL_Rect bgRect = { 10, 560, SPRINT_BAR_WIDTH, SPRINT_BAR_HEIGHT };
-    SDL_RenderFillRect(renderer, &bgRect);
+static void freeRewindBuffer(void) {
+    free(rewindBuffer.ring);
+    free(rewindBuffer.image);
+    free(rewindBuffer.next);
+    free(rewindBuffer.delta);
+    freeSaveCapture(&rewindBuffer.capture);
+    memset(&rewindBuffer, 0, sizeof(rewindBuffer));
+}
 
-    // Draw sprint energy level
-    SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255);
-    SDL_Rect energyRect = { 10, 560, (int)(SPRINT_BAR_WIDTH * (sprintEnergy / MAX_SPRINT_ENERGY)), SPRINT_BAR_HEIGHT };
-    SDL_RenderFillRect(renderer, &energyRect);
+// Append an encoded delta, dropping the oldest until it fits
+static void storeRewindDelta(RewindBuffer* rewind, Uint32 size, Uint32 imageSize) {
+    if (size > REWIND_BUFFER_BYTES) {
+        // A single tick bigger than the ring: history starts over
+        if (rewind->count > 0) printf("Rewind history dropped: one tick changed %u bytes\n", size);
+        rewind->first = rewind->count = 0;
+        rewind->ringUsed = 0;
+        return;
+    }
+    while (rewind->count > 0 && (rewind->count == REWIND_MAX_TICKS || rewind->ringUsed + size > REWIND_BUFFER_BYTES)) {
+        rewind->ringUsed -= rewind->entries[rewind->first].size;
+        rewind->first = (rewind->first + 1) % REWIND_MAX_TICKS;
+        rewind->count--;
+    }
+    Uint32 head = rewind->ringHead;
+    Uint32 firstPart = size < REWIND_BUFFER_BYTES - head ? size : REWIND_BUFFER_BYTES - head;
+    memcpy(rewind->ring + head, rewind->delta, firstPart);
+    memcpy(rewind->ring, rewind->delta + firstPart, size - firstPart);
+    RewindEntry* entry = &rewind->entries[(rewind->first + rewind->count) % REWIND_MAX_TICKS];
+    entry->offset = head;
+    entry->size = size;
+    entry->imageSize = imageSize;
+    rewind->count++;
+    rewind->ringHead = (head + size) % REWIND_BUFFER_BYTES;
+    rewind->ringUsed += size;
+}
 
-    // Show prompts next to sprint bar
-    SDL_Color promptColor = {255, 255, 255};
-    if (isNearGamblingMachine(batarong)) {
-        renderText(renderer, font, "Press A to gamble", promptColor, SPRINT_BAR_WIDTH + 30, 560);
+// Record the state after a tick. Only sections that may have changed are captured and
+// compared, straight against the image; the others go into the delta as a skip.
+static void rewindPush(const Batarong* batarong, bool gameOver) {
+    RewindBuffer* rewind = &rewindBuffer;
+    SaveCapture* capture = &rewind->capture;
+    if (!rewind->ring && !(rewind->ring = malloc(REWIND_BUFFER_BYTES))) return;
+    Uint32 sections = rewind->primed ? saveDirtySections | SAVE_TICK_SECTIONS : SAVE_ALL_SECTIONS;
+    if (!captureSaveSections(capture, batarong, gameOver, sections)) return;
+    // A section that changed size moves the ones after it, so from there on the image is restaged
+    int moved = 0;
+    if (rewind->primed) {
+        Uint32 previous[SAVE_SECTION_COUNT];
+        memcpy(previous, rewind->image, sizeof(previous));
+        while (moved < SAVE_SECTION_COUNT && previous[moved] == capture->size[moved]) moved++;
+    }
+    Uint32 missing = SAVE_ALL_SECTIONS & ~sections & ~((1u << moved) - 1);
+    if (missing && !captureSaveSections(capture, batarong, gameOver, missing)) return;
+    sections |= missing;
+    saveDirtySections = 0;
+
+    Uint32 offset[SAVE_SECTION_COUNT];
+    Uint32 size = rewindLayout(capture->size, offset);
+    if (!reserveRewindImage(rewind, size)) {
+        clearRewind();
+        return;
+    }
+    // Up to the old end, so a shrink encodes as the old bytes going to zero
+    Uint32 end = size > rewind->imageSize ? size : rewind->imageSize;
+    Uint32 restage = moved < SAVE_SECTION_COUNT ? offset[moved] : end;
+    for (int i = moved; i < SAVE_SECTION_COUNT; i++) {
+        Uint32 padded = (capture->size[i] + 7) & ~7u;
+        if (capture->size[i]) memcpy(rewind->next + offset[i], capture->data[i], capture->size[i]);
+        memset(rewind->next + offset[i] + capture->size[i], 0, padded - capture->size[i]);
+    }
+    memset(rewind->next + size, 0, end - size);
+
+    // The previous bullets are overwritten by the encode, so the prediction folds into them
+    if (rewind->primed) xorBulletPrediction(capture->data[SAVE_BULLETS], rewind->image + offset[SAVE_BULLETS]);
+    Uint32 same = 0, encoded = 0;
+    if (moved < SAVE_SECTION_COUNT) {
+        encoded = encodeRewindDelta(rewind->image, (const unsigned char*)capture->size, sizeof(Uint32) * SAVE_SECTION_COUNT,
+                                    rewind->delta, &same);
     } else {
-        // Check if near any Ray NPC
-        for (int i = 0; i < MAX_RAY; i++) {
-            if (isNearRay(batarong, &rayList[i])) {
-                renderText(renderer, font, "Press A to enter shop", promptColor, SPRINT_BAR_WIDTH + 30, 560);
-                break;
-            }
+        same = sizeof(Uint32) * SAVE_SECTION_COUNT;
+    }
+    for (int i = 0; i < moved; i++) {
+        // Section padding is zero on both sides
+        Uint32 padding = ((capture->size[i] + 7) & ~7u) - capture->size[i];
+        if (sections & (1u << i)) {
+            encoded += encodeRewindDelta(rewind->image + offset[i], capture->data[i], capture->size[i],
+                                         rewind->delta + encoded, &same);
+            same += padding;
+        } else {
+            same += capture->size[i] + padding;
         }
     }
+    encoded += encodeRewindDelta(rewind->image + restage, rewind->next + restage, end - restage, rewind->delta + encoded,
+                                 &same);
+    if (rewind->primed) storeRewindDelta(rewind, encoded, rewind->imageSize);
+    rewind->imageSize = size;
+    rewind->primed = true;
 }
 
-// Add these new functions before main()
-void shootBullet(Batarong* batarong) {
-    Uint32 currentTime = SDL_GetTicks();
-    if (currentTime - lastShotTime < SHOOT_COOLDOWN) {
-        return;  // Don't shoot if cooldown hasn't elapsed
+// Step the game back one tick; false when there is no older state left
+static bool rewindStep(Batarong* batarong, bool* gameOver, SDL_Renderer* renderer) {
+    RewindBuffer* rewind = &rewindBuffer;
+    if (rewind->count == 0) return false;
+    const RewindEntry* entry = &rewind->entries[(rewind->first + rewind->count - 1) % REWIND_MAX_TICKS];
+    Uint32 firstPart = entry->size < REWIND_BUFFER_BYTES - entry->offset ? entry->size : REWIND_BUFFER_BYTES - entry->offset;
+    memcpy(rewind->delta, rewind->ring + entry->offset, firstPart);
+    memcpy(rewind->delta + firstPart, rewind->ring, entry->size - firstPart);
+    rewind->ringHead = entry->offset;
+    rewind->ringUsed -= entry->size;
+    rewind->count--;
+    Uint32 size[SAVE_SECTION_COUNT], offset[SAVE_SECTION_COUNT];
+    memcpy(size, rewind->image, sizeof(size));
+    rewindLayout(size, offset);
+    xorBulletPrediction(rewind->image + offset[SAVE_BULLETS], rewind->image + offset[SAVE_BULLETS]);
+    applyRewindDelta(rewind->image, rewind->delta, entry->size);
+    rewind->imageSize = entry->imageSize;
+
+    const unsigned char* data[SAVE_SECTION_COUNT];
+    if (!readRewindImage(rewind->image, rewind->imageSize, data, size) || !saveSectionsValid(data, size)) {
+        clearRewind();
+        return false;
+    }
+    float fromX = batarong->x, fromY = batarong->y;
+    applySaveSections(data, batarong, gameOver, renderer);
+    batarong->prevX = fromX;  // Interpolate along the rewind rather than snapping each tick
+    batarong->prevY = fromY;
+    return true;
+}
+
+// Step back up to ticks ticks; returns how many were available
+static int rewindTicks(int ticks, Batarong* batarong, bool* gameOver, SDL_Renderer* renderer) {
+    int stepped = 0;
+    while (stepped < ticks && rewindStep(batarong, gameOver, renderer)) stepped++;
+    return stepped;
+}
+
+// Deterministic stand-in for a player: runs right, sprints in bursts, jumps and fires
+static void scriptedInput(Uint32 tick, InputState* input) {
+    Uint16 buttons = INPUT_RIGHT | INPUT_SHOOT | INPUT_RESTART;
+    Uint32 second = tick / SIM_TICK_HZ;
+    if (second % 4 < 2) buttons |= INPUT_SPRINT;
+    if (tick % (SIM_TICK_HZ * 3 / 4) == 0) buttons |= INPUT_UP;
+    if (second % 10 == 9) buttons = (Uint16)((buttons & ~INPUT_RIGHT) | INPUT_LEFT);
+    input->buttons = buttons;
+    input->keyCount = 0;
+}
+
+// Cheap LCG so generated levels are identical on every platform
+static Uint32 benchRandom(Uint32* seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+// Swap in a long generated level: a continuous floor plus scattered ledges and piwo.
+// Built as an in-memory level image so it goes through the same path as level files.
+static bool generateStressLevel(int platformTotal, int piwoTotal, Uint32 seed) {
+    Sint32* columns = malloc(sizeof(Sint32) * 2 * (size_t)(platformTotal + piwoTotal > 0 ? platformTotal + piwoTotal : 1));
+    if (!columns) return false;
+    Sint32* px = columns;
+    Sint32* py = px + platformTotal;
+    Sint32* cx = py + platformTotal;
+    Sint32* cy = cx + piwoTotal;
+
+    int floorCount = platformTotal / 2;
+    int levelWidth = floorCount * PLATFORM_WIDTH;
+    for (int i = 0; i < platformTotal; i++) {
+        if (i < floorCount) {
+            px[i] = i * PLATFORM_WIDTH;
+            py[i] = 500;
+        } else {
+            px[i] = (Sint32)(benchRandom(&seed) % (Uint32)levelWidth);
+            py[i] = 100 + (Sint32)(benchRandom(&seed) % 350);
+        }
+    }
+    for (int i = 0; i < piwoTotal; i++) {
+        cx[i] = (Sint32)(benchRandom(&seed) % (Uint32)levelWidth);
+        cy[i] = 100 + (Sint32)(benchRandom(&seed) % 380);
+    }
+    const int32_t* xs[LEVEL_ARRAY_COUNT] = { px, cx, NULL, NULL };
+    const int32_t* ys[LEVEL_ARRAY_COUNT] = { py, cy, NULL, NULL };
+    const uint32_t counts[LEVEL_ARRAY_COUNT] = { (Uint32)platformTotal, (Uint32)piwoTotal, 0, 0 };
+    Uint32 size = 0;
+    MemoryFile image = {0};
+    image.data = levelBuildImage(xs, ys, counts, 0, &size);
+    image.size = size;
+    free(columns);
+    if (!image.data) return false;
+    return bindLevel(&image);
+}
+
+// Run the simulation without a window or renderer, on scripted input or a loaded
+// recording (which sets the tick count). Returns the ticks actually run.
+static Uint32 runSimulation(Batarong* batarong, bool* gameOver, Uint32 ticks, const char* recordPath) {
+    InputState input;
+    *gameOver = false;
+    resetSimulation(batarong);
+    hasGun = true;  // Exercise the bullet path
+    if (inputReplay.replaying) {
+        beginReplay(batarong);
+        ticks = inputReplay.header.tickCount;
+    } else if (recordPath) {
+        startRecording(recordPath, batarong);
+    }
+    Uint32 t = 0;
+    for (; t < ticks; t++) {
+        scriptedInput(t, &input);
+        if (!replayTickInput(&input)) break;
+        simulateTick(batarong, gameOver, &input);
+        replayTickHash(batarong, *gameOver);
     }
+    return t;
+}
+
+static int runHeadless(Uint32 ticks, const char* recordPath, const char* replayPath) {
+    Batarong batarong;
+    bool gameOver;
+    if (!loadLevel(DEFAULT_LEVEL_PATH)) return 1;
+    if (replayPath && !loadReplay(replayPath)) {
+        unloadLevel();
+        return 1;
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+    ticks = runSimulation(&batarong, &gameOver, ticks, recordPath);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+    printf("headless: %u ticks (%.1f s simulated) in %.3f s\n", ticks, (double)ticks / SIM_TICK_HZ, seconds);
+    printf("final state: x=%.2f y=%.2f piwo=%d bullets=%d\n", batarong.x, batarong.y, piwoCount, bulletStore.count);
+    printf("projectile hits: %u\n", projectileHitTotal);
+    bool ok = true;
+    if (replayPath) ok = finishReplay();
+    else if (recordPath) ok = finishRecording(&batarong, gameOver);
+    freeEntityStore(&bulletStore);
+    unloadLevel();
+    return ok ? 0 : 1;
+}
+
+// Spawn bullets flying in every direction around the camera until there are size of them
+static bool topUpBulletSwarm(int size, Uint32* seed) {
+    while (bulletStore.count < size) {
+        float x = (float)(simCameraX + (int)(benchRandom(seed) % STREAM_VIEW_WIDTH));
+        float y = (float)(benchRandom(seed) % WINDOW_HEIGHT);
+        int row = entityRow(&bulletStore, spawnEntity(&bulletStore, x, y, BULLET_WIDTH, BULLET_HEIGHT));
+        if (row < 0) return false;
+        bulletStore.vx[row] = (float)((int)(benchRandom(seed) % 21) - 10) * SIM_TICK_SCALE;
+        bulletStore.vy[row] = (float)((int)(benchRandom(seed) % 21) - 10) * SIM_TICK_SCALE;
+    }
+    return true;
+}
 
-    // Find first inactive bullet
-    for (int i = 0; i < MAX_BULLETS; i++) {
-        if (!bullets[i].active) {
-            bullets[i].active = true;
-            bullets[i].direction = batarong->facingLeft;
-            bullets[i].x = batarong->x + (batarong->facingLeft ? 0 : batarong->width);
-            bullets[i].y = batarong->y + (batarong->height / 2);
-            lastShotTime = currentTime;
-            // Register in active list
-            if (activeBulletCount < MAX_BULLETS) {
-                activeBulletIndices[activeBulletCount++] = i;
+// Swarms of bullets flying in every direction over the shipped level, topped up each tick
+static bool runProjectileBenchmark(Uint32 ticks, double timerOverheadNs) {
+    static const int swarmSizes[] = { 1000, 10000, 100000 };
+    const double frequency = (double)SDL_GetPerformanceFrequency();
+    Uint32 iterations = ticks / 1000 > 100 ? ticks / 1000 : 100;
+    if (!loadLevel(DEFAULT_LEVEL_PATH)) return false;
+    printf("%10s %14s %16s %16s\n", "bullets", "ns/tick", "ns/bullet", "hits/tick");
+    for (size_t s = 0; s < sizeof(swarmSizes) / sizeof(swarmSizes[0]); s++) {
+        Batarong batarong;
+        resetSimulation(&batarong);
+        Uint32 seed = 0xB0117u;
+        Uint64 counter = 0, bulletTicks = 0;
+        for (Uint32 t = 0; t < iterations; t++) {
+            if (!topUpBulletSwarm(swarmSizes[s], &seed)) {
+                unloadLevel();
+                return false;
             }
-            break;
+            bulletTicks += (Uint64)bulletStore.count;
+            Uint64 start = SDL_GetPerformanceCounter();
+            updateBullets();
+            counter += SDL_GetPerformanceCounter() - start;
         }
+        double tickNs = (double)counter / frequency * 1e9 / (double)iterations - timerOverheadNs;
+        if (tickNs < 0.0) tickNs = 0.0;
+        printf("%10d %14.0f %16.2f %16.1f\n", swarmSizes[s], tickNs,
+               tickNs * (double)iterations / (double)bulletTicks, (double)projectileHitTotal / (double)iterations);
     }
+    freeEntityStore(&bulletStore);
+    unloadLevel();
+    return true;
 }
 
-void updateBullets(void) {
-    for (int i = 0; i < activeBulletCount; ) {
-        int idx = activeBulletIndices[i];
-        Bullet* b = &bullets[idx];
-        if (!b->active) {
-            // Remove stale entry (should rarely happen)
-            activeBulletIndices[i] = activeBulletIndices[--activeBulletCount];
+// Platforms and piwo in each benchmark level
+static const int benchLevelSizes[][2] = {
+    { 0, 0 }, // The shipped level file
+    { 1000, 500 },
+    { 10000, 5000 },
+    { 50000, 25000 },
+};
+#define BENCH_LEVEL_COUNT (int)(sizeof(benchLevelSizes) / sizeof(benchLevelSizes[0]))
+
+static bool loadBenchLevel(int level) {
+    if (level == 0) return loadLevel(DEFAULT_LEVEL_PATH);
+    if (generateStressLevel(benchLevelSizes[level][0], benchLevelSizes[level][1], 0xBA7A2026u)) return true;
+    printf("Failed to allocate stress level of %d platforms\n", benchLevelSizes[level][0]);
+    return false;
+}
+
+// Save state costs per benchmark level: the capture on the main thread, the first
+// (full) write, an incremental write a second of play later, and a load
+static bool runSaveStateBenchmark(void) {
+    const double msPerCounter = 1000.0 / (double)SDL_GetPerformanceFrequency();
+    SaveFile file = { SAVE_BENCH_PATH };
+    SaveCapture capture = {0};
+    bool ok = true;
+    printf("%10s %10s %12s %12s %16s %12s\n", "platforms", "piwo", "capture ms", "full ms", "incremental ms", "load ms");
+    for (int level = 0; level < BENCH_LEVEL_COUNT && ok; level++) {
+        if (!loadBenchLevel(level)) {
+            ok = level == 0;
             continue;
         }
-        b->x += b->direction ? -BULLET_SPEED : BULLET_SPEED;
-        if (b->x < cameraX - 100 || b->x > cameraX + 900) {
-            b->active = false;
-            activeBulletIndices[i] = activeBulletIndices[--activeBulletCount];
-            continue; // Don't increment i; swapped element needs processing
+        Batarong batarong;
+        bool gameOver;
+        InputState input;
+        runSimulation(&batarong, &gameOver, SIM_TICK_HZ * 10, NULL);
+        file.valid = false;
+        ok = captureSaveState(&capture, &batarong, gameOver);
+        double captureMs = (double)capture.captureCounter * msPerCounter;
+        Uint64 start = SDL_GetPerformanceCounter();
+        ok = ok && writeSaveFile(&file, &capture) >= 0;
+        double fullMs = (double)(SDL_GetPerformanceCounter() - start) * msPerCounter;
+        for (Uint32 t = 0; t < SIM_TICK_HZ; t++) {
+            scriptedInput(t, &input);
+            simulateTick(&batarong, &gameOver, &input);
+        }
+        ok = ok && captureSaveState(&capture, &batarong, gameOver);
+        start = SDL_GetPerformanceCounter();
+        int written = ok ? writeSaveFile(&file, &capture) : -1;
+        double incrementalMs = (double)(SDL_GetPerformanceCounter() - start) * msPerCounter;
+        start = SDL_GetPerformanceCounter();
+        ok = written >= 0 && loadSaveFile(&file, &batarong, &gameOver, NULL);
+        double loadMs = (double)(SDL_GetPerformanceCounter() - start) * msPerCounter;
+        if (ok) {
+            printf("%10d %10d %12.3f %12.3f %9.3f (%d/%d) %12.3f\n", platformCount, piwoListCount, captureMs, fullMs,
+                   incrementalMs, written, SAVE_SECTION_COUNT, loadMs);
         }
-        i++; // Only advance if bullet remains active
+        unloadLevel();
     }
+    remove(SAVE_BENCH_PATH);
+    freeSaveCapture(&capture);
+    freeEntityStore(&bulletStore);
+    return ok;
 }
 
-void renderBullets(SDL_Renderer* renderer) {
-    SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);  // Yellow bullets
-    for (int i = 0; i < MAX_BULLETS; i++) {
-        if (bullets[i].active) {
-            SDL_Rect bulletRect = {
-                bullets[i].x - cameraX,
-                bullets[i].y,
-                BULLET_WIDTH,
-                BULLET_HEIGHT
-            };
-            SDL_RenderFillRect(renderer, &bulletRect);
+// Rewind costs per benchmark level next to the tick they ride on, and whether
+// rewinding two seconds lands on exactly the state recorded at the time. The last
+// row repeats the shipped level with a swarm of REWIND_BENCH_SWARM bullets.
+static bool runRewindBenchmark(void) {
+    const double nsPerCounter = 1e9 / (double)SDL_GetPerformanceFrequency();
+    const int back = SIM_TICK_HZ * 2;
+    bool ok = true;
+    printf("%10s %10s %10s %12s %12s %12s %10s %12s %8s\n", "platforms", "piwo", "bullets", "ns/tick", "ns/push",
+           "bytes/tick", "s kept", "ns/step", "exact");
+    for (int run = 0; run <= BENCH_LEVEL_COUNT; run++) {
+        int level = run < BENCH_LEVEL_COUNT ? run : 0;
+        int swarm = run < BENCH_LEVEL_COUNT ? 0 : REWIND_BENCH_SWARM;
+        if (!loadBenchLevel(level)) {
+            if (level == 0) continue;
+            ok = false;
+            break;
+        }
+        Batarong batarong;
+        bool gameOver;
+        InputState input;
+        Uint32 seed = 0xB0117u;
+        runSimulation(&batarong, &gameOver, SIM_TICK_HZ * 10, NULL);
+        clearRewind();
+        rewindPush(&batarong, gameOver);
+        Uint64 tickCounter = 0, pushCounter = 0, target = 0;
+        for (int t = 1; t <= REWIND_MAX_TICKS; t++) {
+            if (!topUpBulletSwarm(swarm, &seed)) {
+                ok = false;
+                break;
+            }
+            scriptedInput((Uint32)t, &input);
+            Uint64 start = SDL_GetPerformanceCounter();
+            simulateTick(&batarong, &gameOver, &input);
+            Uint64 middle = SDL_GetPerformanceCounter();
+            rewindPush(&batarong, gameOver);
+            tickCounter += middle - start;
+            pushCounter += SDL_GetPerformanceCounter() - middle;
+            if (t == REWIND_MAX_TICKS - back) target = hashWorldState(&batarong, gameOver);
+        }
+        int kept = rewindBuffer.count;
+        double bytesPerTick = kept ? (double)rewindBuffer.ringUsed / kept : 0.0;
+        Uint64 start = SDL_GetPerformanceCounter();
+        int stepped = rewindTicks(back, &batarong, &gameOver, NULL);
+        double stepNs = stepped ? (double)(SDL_GetPerformanceCounter() - start) * nsPerCounter / stepped : 0.0;
+        bool exact = stepped == back && hashWorldState(&batarong, gameOver) == target;
+        ok = ok && exact;
+        printf("%10d %10d %10d %12.0f %12.0f %12.1f %10.1f %12.0f %8s\n", platformCount, piwoListCount, bulletStore.count,
+               (double)tickCounter * nsPerCounter / REWIND_MAX_TICKS, (double)pushCounter * nsPerCounter / REWIND_MAX_TICKS,
+               bytesPerTick, (double)kept / SIM_TICK_HZ, stepNs, exact ? "yes" : "NO");
+        unloadLevel();
+    }
+    freeRewindBuffer();
+    freeEntityStore(&bulletStore);
+    return ok;
+}
+
+static int runBenchmark(Uint32 ticks) {
+    const double frequency = (double)SDL_GetPerformanceFrequency();
+
+    // Cost of an empty start/stop counter pair, subtracted from the per-call figures
+    Uint64 overheadCounter = 0;
+    for (int i = 0; i < 100000; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        overheadCounter += SDL_GetPerformanceCounter() - start;
+    }
+    double timerOverheadNs = (double)overheadCounter / frequency * 1e9 / 100000.0;
+
+    chooseOverlapKernel();
+    printf("benchmark: %u ticks per level at %d Hz (timer overhead %.1f ns removed, %s overlap kernel)\n",
+           ticks, SIM_TICK_HZ, timerOverheadNs, overlapKernelName);
+    printf("%10s %10s %14s %16s %16s\n", "platforms", "piwo", "ticks/sec", "ns/checkColl", "ns/updateBull");
+    for (int i = 0; i < BENCH_LEVEL_COUNT; i++) {
+        if (!loadBenchLevel(i)) {
+            if (i == 0) continue;
+            return 1;
         }
+        SimTimings timings = {0};
+        Batarong batarong;
+        bool gameOver;
+        simTimings = &timings;
+        Uint64 start = SDL_GetPerformanceCounter();
+        runSimulation(&batarong, &gameOver, ticks, NULL);
+        double seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+        simTimings = NULL;
+        double collisionNs = timings.collisionCalls ? (double)timings.collisionCounter / frequency * 1e9 / (double)timings.collisionCalls - timerOverheadNs : 0.0;
+        double bulletNs = timings.bulletCalls ? (double)timings.bulletCounter / frequency * 1e9 / (double)timings.bulletCalls - timerOverheadNs : 0.0;
+        if (collisionNs < 0.0) collisionNs = 0.0;
+        if (bulletNs < 0.0) bulletNs = 0.0;
+        printf("%10d %10d %14.0f %16.1f %16.1f\n", platformCount, piwoListCount,
+               seconds > 0.0 ? (double)ticks / seconds : 0.0, collisionNs, bulletNs);
+        unloadLevel();
     }
+    freeEntityStore(&bulletStore);
+    if (!runProjectileBenchmark(ticks, timerOverheadNs)) return 1;
+    if (!runSaveStateBenchmark()) return 1;
+    return runRewindBenchmark() ? 0 : 1;
 }
 
-int main(void) {
-    // Load character config prior to SDL image loads
-    loadCharacterConfig("config/config.md");
+int main(int argc, char* argv[]) {
+    // Windowless modes: --headless [ticks] and --bench [ticks].
+    // --record <file> / --replay <file> work headless and in the window.
+    bool headless = false, bench = false, ticksGiven = false;
+    Uint32 ticks = 0;
+    const char* recordPath = NULL;
+    const char* replayPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (strcmp(argv[i], "--bench") == 0) bench = true;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPath = argv[++i];
+        else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+            ticks = (Uint32)strtoul(argv[i], NULL, 10);
+            ticksGiven = true;
+        } else {
+            printf("Ignoring unknown argument: %s\n", argv[i]);
+        }
+    }
+    if (recordPath && replayPath) {
+        printf("--record and --replay can't be used together\n");
+        return 1;
+    }
+    if (bench) return runBenchmark(ticksGiven ? ticks : BENCH_DEFAULT_TICKS);
+    if (headless) return runHeadless(ticksGiven ? ticks : HEADLESS_DEFAULT_TICKS, recordPath, replayPath);
+
+#ifdef TRACING
+    traceStart();
+#endif
+
+    // Map the asset pack, then load character config prior to SDL image loads
+    openAssetPack(ASSET_PACK_PATH);
+    loadCharacterConfig(CONFIG_PATH);
+    applyShopConfig();
+    if (!loadLevel(DEFAULT_LEVEL_PATH)) {
+        closeAssetPack();
+        return 1;
+    }
+    if (replayPath && !loadReplay(replayPath)) {
+        unloadLevel();
+        closeAssetPack();
+        return 1;
+    }
 
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        closeAssetPack();
         return 1;
     }
 
     // Initialize SDL_ttf
     if (TTF_Init() == -1) {
         printf("SDL_ttf could not initialize! TTF_Error: %s\n", TTF_GetError());
+        closeAssetPack();
         SDL_Quit();
         return 1;
     }
 
-    // Load font file fully into memory then use RWops
-    if (readFileToMemory("COMIC.TTF", &mainFontMem) != 0) {
+    // Font bytes come straight from the pack (or a loose copy) and are read through RWops
+    if (loadAsset("COMIC.TTF", &mainFontMem) != 0) {
         printf("Failed to read font file into memory.\n");
+        closeAssetPack();
         TTF_Quit();
         SDL_Quit();
         return 1;
@@ -1037,13 +5934,17 @@ int main(void) {
     TTF_Font* font = TTF_OpenFontRW(fontRW, 1, REGULAR_FONT_SIZE);
     if (!font) {
         printf("Failed to open main font from memory: %s\n", TTF_GetError());
-        SDL_RWclose(fontRW);
+        SDL_RWclose(smallFontRW);
+        releaseMemoryFile(&mainFontMem);
+        closeAssetPack();
         TTF_Quit(); SDL_Quit(); return 1;
     }
     TTF_Font* smallFont = TTF_OpenFontRW(smallFontRW, 1, SMALL_FONT_SIZE);
     if (!smallFont) {
         printf("Failed to open small font from memory: %s\n", TTF_GetError());
         TTF_CloseFont(font);
+        releaseMemoryFile(&mainFontMem);
+        closeAssetPack();
         TTF_Quit(); SDL_Quit(); return 1;
     }
 
@@ -1061,7 +5962,8 @@ int main(void) {
     }
 
     // Create a renderer
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, 0); // Create a renderer
+    // Presentation is vsync-paced; simulation runs on its own fixed tick
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
     (void)renderer;
 
     if (renderer == NULL) {
@@ -1073,19 +5975,25 @@ int main(void) {
         return 1;
     }
 
-    // Total steps for loading screen (adjust if adding more assets)
-    const int totalSteps = 7;
-    int step = 0;
-    renderLoadingScreen(renderer, font, "Loading background", ++step, totalSteps);
-    // Load background into memory first
-    MemoryFile bgMem = {0};
-    readFileToMemory(getCharacterImage("default", "images/bliss.bmp"), &bgMem);
-    SDL_RWops* bgRW = SDL_RWFromConstMem(bgMem.data, (int)bgMem.size);
-    SDL_Surface* bgSurface = bgRW ? SDL_LoadBMP_RW(bgRW, 1) : NULL;
-    SDL_Texture* bgTexture = bgSurface ? SDL_CreateTextureFromSurface(renderer, bgSurface) : NULL;
-    if (bgSurface) SDL_FreeSurface(bgSurface);
+    // Rasterize both fonts into glyph atlases before any text is drawn
+    TTF_Font* atlasFonts[] = { font, smallFont };
+    if (!initTextRenderer(renderer, atlasFonts, 2)) {
+        printf("Glyph atlas unavailable, falling back to per-string text rendering.\n");
+    }
 
-    if (bgTexture == NULL) {
+    // Decode every asset in parallel behind the loading bar; the acquires below are cache hits
+    const AssetRequest startupAssets[] = {
+        { "default", "images/bliss.bmp", false },
+        { "player", "images/batarong.bmp", true },
+        { "piwo", "images/piwo.bmp", true },
+        { "gambling_machine", "images/gambling.bmp", true },
+        { "ray", "images/ray.bmp", true },
+        { "gun", "images/gun.bmp", true },
+    };
+    TRACE("loadAssets", loadAssets(renderer, font, startupAssets, (int)(sizeof(startupAssets) / sizeof(startupAssets[0]))));
+
+    Sprite bgSprite = acquireSprite(renderer, "default", "images/bliss.bmp");
+    if (bgSprite.texture == NULL) {
         printf("Unable to create background texture! SDL Error: %s\n", SDL_GetError());
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
@@ -1095,14 +6003,10 @@ int main(void) {
         return 1;
     }
 
-    renderLoadingScreen(renderer, font, "Loading player", ++step, totalSteps);
-    MemoryFile playerMem = {0};
-    readFileToMemory(getCharacterImage("player", "images/batarong.bmp"), &playerMem);
-    SDL_RWops* playerRW = SDL_RWFromConstMem(playerMem.data, (int)playerMem.size);
-    SDL_Surface* tempSurface = playerRW ? SDL_LoadBMP_RW(playerRW, 1) : NULL;
-    if (tempSurface == NULL) {
+    Sprite playerSprite = acquireSprite(renderer, "player", "images/batarong.bmp");
+    if (playerSprite.texture == NULL) {
         printf("Unable to load image! SDL Error: %s\n", SDL_GetError());
-        SDL_DestroyTexture(bgTexture);
+        destroyTextureCache();
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         TTF_CloseFont(font);
@@ -1110,33 +6014,16 @@ int main(void) {
         SDL_Quit();
         return 1;
     }
-
-    // Create a texture from the surface
-    Batarong batarong = {300, 400, tempSurface->w, tempSurface->h, 
-                         SDL_CreateTextureFromSurface(renderer, tempSurface), 
-                         0, true, false, MAX_SPRINT_ENERGY, false, true}; // Add true for sprintKeyReleased
-    SDL_FreeSurface(tempSurface); // Free the temporary surface
-
-    if (batarong.texture == NULL) {
-        printf("Unable to create texture! SDL Error: %s\n", SDL_GetError());
-        SDL_DestroyTexture(bgTexture);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        TTF_CloseFont(font);
-        TTF_Quit();
-        SDL_Quit();
-        return 1;
-    }
-
-    renderLoadingScreen(renderer, font, "Loading piwo", ++step, totalSteps);
-    MemoryFile piwoMem = {0};
-    readFileToMemory(getCharacterImage("piwo", "images/piwo.bmp"), &piwoMem);
-    SDL_RWops* piwoRW = SDL_RWFromConstMem(piwoMem.data, (int)piwoMem.size);
-    SDL_Surface* piwoSurface = piwoRW ? SDL_LoadBMP_RW(piwoRW, 1) : NULL; // From config
-    if (piwoSurface == NULL) {
+    Batarong batarong = {300, 400, playerSprite.src.w, playerSprite.src.h,
+                         playerSprite,
+                         0, true, false, MAX_SPRINT_ENERGY, false, true, // Add true for sprintKeyReleased
+                         300, 400};
+
+    // One texture shared by every piwo
+    piwoSprite = acquireSprite(renderer, "piwo", "images/piwo.bmp");
+    if (piwoSprite.texture == NULL) {
         printf("Unable to load piwo image! SDL Error: %s\n", SDL_GetError());
-        SDL_DestroyTexture(batarong.texture);
-        SDL_DestroyTexture(bgTexture);
+        destroyTextureCache();
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         TTF_CloseFont(font);
@@ -1145,203 +6032,228 @@ int main(void) {
         return 1;
     }
 
-    // Create a texture from the surface for each piwo
-    for (int i = 0; i < MAX_PIWO; i++) {
-        piwoList[i].texture = SDL_CreateTextureFromSurface(renderer, piwoSurface);
-    }
-    SDL_FreeSurface(piwoSurface); // Free the temporary surface
-
-    renderLoadingScreen(renderer, font, "Loading gambling machine", ++step, totalSteps);
-    MemoryFile gamblingMem = {0};
-    readFileToMemory(getCharacterImage("gambling_machine", "images/gambling.bmp"), &gamblingMem);
-    SDL_RWops* gamblingRW = SDL_RWFromConstMem(gamblingMem.data, (int)gamblingMem.size);
-    SDL_Surface* gamblingMachineSurface = gamblingRW ? SDL_LoadBMP_RW(gamblingRW, 1) : NULL;
-    if (gamblingMachineSurface == NULL) {
+    gamblingMachineSprite = acquireSprite(renderer, "gambling_machine", "images/gambling.bmp");
+    if (gamblingMachineSprite.texture == NULL) {
         printf("Unable to load gambling machine image! SDL Error: %s\n", SDL_GetError());
-        // ... handle error ...
     }
-    gamblingMachine.texture = SDL_CreateTextureFromSurface(renderer, gamblingMachineSurface);
-    SDL_FreeSurface(gamblingMachineSurface);
 
-    renderLoadingScreen(renderer, font, "Loading ray", ++step, totalSteps);
-    MemoryFile rayMem = {0};
-    readFileToMemory(getCharacterImage("ray", "images/ray.bmp"), &rayMem);
-    SDL_RWops* rayRW = SDL_RWFromConstMem(rayMem.data, (int)rayMem.size);
-    SDL_Surface* raySurface = rayRW ? SDL_LoadBMP_RW(rayRW, 1) : NULL;
-    if (raySurface == NULL) {
+    // One texture shared by every Ray NPC
+    raySprite = acquireSprite(renderer, "ray", "images/ray.bmp");
+    if (raySprite.texture == NULL) {
         printf("Unable to load Ray image! SDL Error: %s\n", SDL_GetError());
-        // ... handle error ...
     }
 
-    // Create texture for each Ray NPC
-    for (int i = 0; i < MAX_RAY; i++) {
-        rayList[i].texture = SDL_CreateTextureFromSurface(renderer, raySurface);
-    }
-    SDL_FreeSurface(raySurface);
-
-    renderLoadingScreen(renderer, font, "Loading gun", ++step, totalSteps);
-    MemoryFile gunMem = {0};
-    readFileToMemory(getCharacterImage("gun", "images/gun.bmp"), &gunMem);
-    SDL_RWops* gunRW = SDL_RWFromConstMem(gunMem.data, (int)gunMem.size);
-    SDL_Surface* gunSurface = gunRW ? SDL_LoadBMP_RW(gunRW, 1) : NULL;
-    if (gunSurface == NULL) {
+    gunSprite = acquireSprite(renderer, "gun", "images/gun.bmp");
+    if (gunSprite.texture == NULL) {
         printf("Unable to load gun image! SDL Error: %s\n", SDL_GetError());
-    } else {
-        gunTexture = SDL_CreateTextureFromSurface(renderer, gunSurface);
-        SDL_FreeSurface(gunSurface);
     }
 
-    renderLoadingScreen(renderer, font, "Finishing", ++step, totalSteps);
+    // Every long-lived sprite, so edits to config/ and images/ show up live
+    const HotSprite hotSprites[] = {
+        { "default", "images/bliss.bmp", &bgSprite },
+        { "player", "images/batarong.bmp", &batarong.sprite, &batarong },
+        { "piwo", "images/piwo.bmp", &piwoSprite },
+        { "gambling_machine", "images/gambling.bmp", &gamblingMachineSprite },
+        { "ray", "images/ray.bmp", &raySprite },
+        { "gun", "images/gun.bmp", &gunSprite },
+        { dialogState.portraitKey, "images/batarong.bmp", &dialogState.portrait },
+    };
+    const int hotSpriteCount = (int)(sizeof(hotSprites) / sizeof(hotSprites[0]));
+    startHotReload();
+
     // Game loop
     bool running = true;
     bool gameOver = false; // Game over state
 
-    // Frame rate control
-    const int targetFPS = 30;
-    const int frameDelay = 1000 / targetFPS; // Delay in milliseconds
-
-    // renderer is available in local scope
+    // Fixed-timestep simulation: input, physics and bullets advance in
+    // SIM_TICK_HZ steps regardless of how fast frames are presented
+    const double tickSeconds = 1.0 / SIM_TICK_HZ;
+    const double counterFrequency = (double)SDL_GetPerformanceFrequency();
+    Uint64 previousCounter = SDL_GetPerformanceCounter();
+    double accumulator = 0.0;
+    simCameraX = (int)batarong.x - (800 / 2);
+    updateWorldStreaming(simCameraX, batarong.facingLeft);
+    scanPlayerOverlaps(&batarong, false);
+    if (replayPath) {
+        beginReplay(&batarong);
+    } else {
+        // A fresh seed per session; recordings keep theirs
+        Uint64 counter = SDL_GetPerformanceCounter();
+        simRngSeed = simRngState = (Uint32)(counter ^ (counter >> 32));
+        if (recordPath) startRecording(recordPath, &batarong);
+    }
+    rewindPush(&batarong, gameOver);  // The oldest state rewind can reach
+#ifdef PROFILER
+    profileStart();
+#endif
 
     while (running) {
-        Uint32 frameStart = SDL_GetTicks(); // Get the start time of the frame
+        Uint64 currentCounter = SDL_GetPerformanceCounter();
+        double frameSeconds = (double)(currentCounter - previousCounter) / counterFrequency;
+        previousCounter = currentCounter;
+        if (frameSeconds > SIM_MAX_FRAME_SECONDS) frameSeconds = SIM_MAX_FRAME_SECONDS;
+        accumulator += frameSeconds;
+
+        TRACE_BEGIN("frame");
+        TRACE("pollEvents", pollEvents(&running));
+        TRACE("applyHotReloads", applyHotReloads(renderer, hotSprites, hotSpriteCount));
+
+        while (accumulator >= tickSeconds) {
+            InputState input;
+            readKeyboardInput(&input);
+            if (!replayTickInput(&input)) {
+                running = false;  // Recording finished
+                break;
+            }
+            if ((input.buttons & INPUT_REWIND) && !inputReplay.recording && !inputReplay.replaying) {
+                TRACE("rewindStep", rewindStep(&batarong, &gameOver, renderer));
+            } else {
+                TRACE("simulateTick", simulateTick(&batarong, &gameOver, &input));
+                replayTickHash(&batarong, gameOver);
+                TRACE("rewindPush", rewindPush(&batarong, gameOver));
+            }
+            accumulator -= tickSeconds;
+        }
 
-        // Handle input
-        handleInput(&running, &batarong, &gameOver);
+        // Save states apply between ticks; a save that finds the writer busy retries next frame
+        if (saveStateRequested && requestSaveState(&batarong, gameOver)) saveStateRequested = false;
+        if (loadStateRequested) {
+            loadStateRequested = false;
+            if (loadSaveState(&batarong, &gameOver, renderer)) {
+                clearRewind();  // History before the load isn't this game's past
+                rewindPush(&batarong, gameOver);
+            }
+        }
 
-    if (!gameOver && !isPaused) {
-            // Apply gravity
-            applyGravity(&batarong);
+        // Blend between the last two simulation states
+        float alpha = (float)(accumulator / tickSeconds);
+        int playerX = (int)(batarong.prevX + (batarong.x - batarong.prevX) * alpha);
+        int playerY = (int)(batarong.prevY + (batarong.y - batarong.prevY) * alpha);
 
-            // Check for collisions with platforms and piwo
-            checkCollision(&batarong, &gameOver);
+        // Update camera position to follow the player
+        cameraX = playerX - (800 / 2); // Center the camera on the player
 
-            // Add bullet updates here
-            updateBullets();
-        }
+        // Bake any static layer tiles the camera reached (render target switches must precede the clear)
+        bool staticCached = false;
+        PROFILE(PROFILE_STATIC_LAYER, staticCached = updateStaticLayer(renderer, cameraX));
 
-        // Update camera position to follow the player
-        cameraX = batarong.x - (800 / 2); // Center the camera on the player
+        // Decide what's on screen once; every world-space draw below uses the result
+        SDL_Rect view = { cameraX, 0, STREAM_VIEW_WIDTH, WINDOW_HEIGHT };
+        PROFILE(PROFILE_CULL, cullWorld(&view, alpha, !staticCached));
 
         // Clear the screen
         SDL_RenderClear(renderer);
 
         // Draw background
         SDL_Rect bgRect = { 0, 0, 800, 600 };
-        SDL_RenderCopy(renderer, bgTexture, NULL, &bgRect);
+        SDL_RenderCopy(renderer, bgSprite.texture, &bgSprite.src, &bgRect);
 
-        // Render the platforms
-        renderPlatforms(renderer);
+        if (staticCached) {
+            // Platforms, gambling machines and Ray NPCs from the baked tiles
+            PROFILE(PROFILE_STATIC_LAYER, drawStaticLayer(renderer));
+        } else {
+            // Render the platforms
+            PROFILE(PROFILE_PLATFORMS, renderPlatforms(renderer));
 
-        // Render gambling machine before player
-        SDL_Rect machineRect = {
-            gamblingMachine.x - cameraX,
-            gamblingMachine.y,
-            GAMBLING_MACHINE_WIDTH,
-            GAMBLING_MACHINE_HEIGHT
-        };
-        SDL_RenderCopy(renderer, gamblingMachine.texture, NULL, &machineRect);
+            // Render gambling machines before player
+            PROFILE(PROFILE_MACHINES, renderMachines(renderer));
+        }
 
         // Render the piwo collectibles
-        renderPiwo(renderer);
+        PROFILE(PROFILE_PIWO, renderPiwo(renderer));
 
         // Render Ray NPCs
-        for (int i = 0; i < MAX_RAY; i++) {
-            SDL_Rect rayRect = {
-                rayList[i].x - cameraX,
-                rayList[i].y,
-                RAY_WIDTH,
-                RAY_HEIGHT
-            };
-            SDL_RenderCopy(renderer, rayList[i].texture, NULL, &rayRect);
-        }
+        if (!staticCached) PROFILE(PROFILE_RAYS, renderRays(renderer));
+        PROFILE(PROFILE_FLUSH, flushRenderBatch(renderer));
 
         if (gameOver) {
             // Render the game over screen
-            renderGameOver(renderer, font);
+            PROFILE(PROFILE_SCREENS, renderGameOver(renderer, font));
         } else if (isGambling) {
-            renderGamblingScreen(renderer, font, smallFont);
+            PROFILE(PROFILE_SCREENS, renderGamblingScreen(renderer, font, smallFont));
         } else if (isShoppingOpen) {
-            renderShopScreen(renderer, font);
+            PROFILE(PROFILE_SCREENS, renderShopScreen(renderer, font));
         } else if (isPaused) {
             // Render gameplay elements behind pause (player, HUD already drawn below)
-            SDL_Rect batarongRect = { batarong.x - cameraX, batarong.y, batarong.width, batarong.height };
-            SDL_RenderCopyEx(renderer, batarong.texture, NULL, &batarongRect,
-                           0, NULL, batarong.facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
-            if (hasGun) {
-                SDL_Rect gunRect = { 
-                    batarong.x - cameraX + (batarong.facingLeft ? -32 : batarong.width), 
-                    batarong.y + 20, 
-                    32, 32 
-                };
-                SDL_RenderCopyEx(renderer, gunTexture, NULL, &gunRect,
-                               0, NULL, batarong.facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
-            }
-            SDL_Color textColor = { 255, 255, 255 };
-            char counterText[20];
-            sprintf(counterText, "Piwo: %d", piwoCount);
-            renderText(renderer, font, counterText, textColor, 650, 10);
-            renderSprintBar(renderer, batarong.sprintEnergy, &batarong, font);
-            renderPauseScreen(renderer, font);
+            PROFILE(PROFILE_PLAYER, renderPlayer(renderer, &batarong, playerX, playerY));
+            PROFILE(PROFILE_HUD, {
+                SDL_Color textColor = { 255, 255, 255 };
+                char counterText[20];
+                sprintf(counterText, "Piwo: %d", piwoCount);
+                renderText(renderer, font, counterText, textColor, 650, 10);
+                renderSprintBar(renderer, batarong.sprintEnergy, &batarong, font);
+            });
+            PROFILE(PROFILE_SCREENS, renderPauseScreen(renderer, font));
         } else {
-            // Render the player texture (now after gambling machine)
-            SDL_Rect batarongRect = { batarong.x - cameraX, batarong.y, batarong.width, batarong.height }; // Adjust player position
-            SDL_RenderCopyEx(renderer, batarong.texture, NULL, &batarongRect, 
-                           0, NULL, batarong.facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
-
-            // After rendering the player but before the HUD
-            if (hasGun) {
-                SDL_Rect gunRect = { 
-                    batarong.x - cameraX + (batarong.facingLeft ? -32 : batarong.width), 
-                    batarong.y + 20, 
-                    32, 32 
-                };
-                SDL_RenderCopyEx(renderer, gunTexture, NULL, &gunRect, 
-                               0, NULL, batarong.facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
-            }
-
-            // Render the piwo counter
-            SDL_Color textColor = { 255, 255, 255 }; // White color for text
-            char counterText[20];
-            sprintf(counterText, "Piwo: %d", piwoCount); // Create the counter text
-            renderText(renderer, font, counterText, textColor, 650, 10); // Position the counter at the top right
-
-            // Render sprint bar
-            renderSprintBar(renderer, batarong.sprintEnergy, &batarong, font);
+            // Render the player and held gun (now after gambling machine, before the HUD)
+            PROFILE(PROFILE_PLAYER, renderPlayer(renderer, &batarong, playerX, playerY));
+
+            PROFILE(PROFILE_HUD, {
+                // Render the piwo counter
+                SDL_Color textColor = { 255, 255, 255 }; // White color for text
+                char counterText[20];
+                sprintf(counterText, "Piwo: %d", piwoCount); // Create the counter text
+                renderText(renderer, font, counterText, textColor, 650, 10); // Position the counter at the top right
+
+                // Render sprint bar
+                renderSprintBar(renderer, batarong.sprintEnergy, &batarong, font);
+            });
         }
 
         // Add bullet rendering here
-        renderBullets(renderer);
+        PROFILE(PROFILE_RENDER_BULLETS, renderBullets(renderer, alpha));
 
     // Always render dialog last so overlay appears above HUD
-    dialog_draw(renderer, font);
+    PROFILE(PROFILE_DIALOG, dialog_draw(renderer, font));
 
-        // Present the back buffer
-        SDL_RenderPresent(renderer); 
+#ifdef PROFILER
+        drawProfileOverlay(renderer, smallFont);
+#endif
 
-        // Cap frame rate
-        Uint32 frameTime = SDL_GetTicks() - frameStart;
-        if (frameDelay > frameTime) {
-            SDL_Delay(frameDelay - frameTime);
-        }
+        // Present the back buffer (blocks on vsync when available)
+        PROFILE(PROFILE_PRESENT, SDL_RenderPresent(renderer));
+#ifdef PROFILER
+        profileEndFrame();
+#endif
+        TRACE_END("frame");
     }
 
     // Clean up resources
-    SDL_DestroyTexture(batarong.texture); // Destroy the player texture
-    SDL_DestroyTexture(bgTexture); // Destroy the background texture
-    for (int i = 0; i < MAX_PIWO; i++) {
-        SDL_DestroyTexture(piwoList[i].texture); // Destroy each piwo texture
-    }
-    SDL_DestroyTexture(gamblingMachine.texture);
-    for (int i = 0; i < MAX_RAY; i++) {
-        SDL_DestroyTexture(rayList[i].texture);
-    }
-    SDL_DestroyTexture(gunTexture);
+#ifdef PROFILER
+    writeProfileCsv(PROFILE_CSV_PATH);
+#endif
+    stopHotReload();
+    stopSaveWriter();
+    freeRewindBuffer();
+    bool replayOk = true;
+    if (replayPath) replayOk = finishReplay();
+    else if (recordPath) replayOk = finishRecording(&batarong, gameOver);
+    dialog_close();
+    releaseSprite(batarong.sprite);
+    releaseSprite(bgSprite);
+    releaseSprite(piwoSprite);
+    releaseSprite(gamblingMachineSprite);
+    releaseSprite(raySprite);
+    releaseSprite(gunSprite);
+    destroyStaticLayer();
+    destroyTextureCache(); // Every image texture is freed here
+    destroyTextRenderer();
+    freeVisibleLists();
+    destroyRenderBatch();
+    freeEntityStore(&bulletStore);
+    unloadLevel();
+#ifdef TRACING
+    writeTraceJson(TRACE_JSON_PATH); // Every traced thread has stopped by now
+#endif
     SDL_DestroyRenderer(renderer); // Destroy the renderer
     SDL_DestroyWindow(window); // Destroy the window
     TTF_CloseFont(smallFont);
     TTF_CloseFont(font); // Close the font
+    releaseMemoryFile(&mainFontMem); // Fonts read from it until closed
+    closeAssetPack();
+    destroyConfigRegistry();
     TTF_Quit(); // Quit SDL_ttf
     SDL_Quit(); // Quit SDL
 
-    return 0;
+    return replayOk ? 0 : 1;
 }
@@ -0,0 +1,171 @@
+/*
+ * Binary level format shared by the game and tools/levelc.
+ *
+ * A level file is a LevelHeader followed by structure-of-arrays blocks:
+ * for every entity kind an x column and a y column of int32 values. All
+ * offsets are from the start of the file and aligned to LEVEL_ALIGNMENT,
+ * so the game can mmap the file and point straight into it.
+ * Values are little-endian; endianTag guards against foreign files.
+ *
+ * The world is split into chunkCount horizontal chunks of chunkWidth
+ * pixels starting at originX. Every column is sorted by x, so each chunk's
+ * entities are a contiguous range: the chunk table at chunkOffset holds
+ * (chunkCount + 1) rows of LEVEL_ARRAY_COUNT start indices, and chunk c
+ * of kind k spans [table[c][k], table[c + 1][k]). An entity belongs to the
+ * chunk containing its x.
+ */
+#ifndef LEVEL_FORMAT_H
+#define LEVEL_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEVEL_MAGIC "BLVL"
+#define LEVEL_VERSION 2
+#define LEVEL_ENDIAN_TAG 0x01020304u
+#define LEVEL_ALIGNMENT 32
+#define LEVEL_DEFAULT_CHUNK_WIDTH 1024
+#define LEVEL_MAX_CHUNKS 1000000u
+
+enum {
+    LEVEL_PLATFORMS,
+    LEVEL_PIWO,
+    LEVEL_RAYS,
+    LEVEL_MACHINES,
+    LEVEL_ARRAY_COUNT
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t xOffset;   // int32_t x[count]
+    uint32_t yOffset;   // int32_t y[count]
+} LevelArray;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t fileSize;
+    int32_t originX;        // World x of the left edge of chunk 0
+    uint32_t chunkWidth;
+    uint32_t chunkCount;
+    uint32_t chunkOffset;   // uint32_t table[chunkCount + 1][LEVEL_ARRAY_COUNT]
+    LevelArray arrays[LEVEL_ARRAY_COUNT];
+} LevelHeader;
+
+static inline uint32_t levelAlign(uint32_t offset) {
+    return (offset + (LEVEL_ALIGNMENT - 1)) & ~(uint32_t)(LEVEL_ALIGNMENT - 1);
+}
+
+// Chunk holding world x, clamped to the level
+static inline uint32_t levelChunkIndex(const LevelHeader* header, int64_t x) {
+    int64_t c = (x - header->originX) / (int64_t)header->chunkWidth;
+    if (x < header->originX || c < 0) return 0;
+    if (c >= (int64_t)header->chunkCount) return header->chunkCount - 1;
+    return (uint32_t)c;
+}
+
+// Stable sort of (x, y) pairs by x; returns -1 if out of memory
+static inline int levelSortByX(int32_t* x, int32_t* y, uint32_t count) {
+    if (count < 2) return 0;
+    int32_t* tx = (int32_t*)malloc(count * sizeof(int32_t));
+    int32_t* ty = (int32_t*)malloc(count * sizeof(int32_t));
+    if (!tx || !ty) { free(tx); free(ty); return -1; }
+    // Bottom-up merge sort, ping-ponging between the columns and the scratch copy
+    int32_t *srcX = x, *srcY = y, *dstX = tx, *dstY = ty;
+    for (uint32_t width = 1; width < count; width *= 2) {
+        for (uint32_t lo = 0; lo < count; lo += 2 * width) {
+            uint32_t mid = lo + width < count ? lo + width : count;
+            uint32_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+            uint32_t a = lo, b = mid, k = lo;
+            while (a < mid && b < hi) {
+                if (srcX[b] < srcX[a]) { dstX[k] = srcX[b]; dstY[k++] = srcY[b++]; }
+                else { dstX[k] = srcX[a]; dstY[k++] = srcY[a++]; }
+            }
+            while (a < mid) { dstX[k] = srcX[a]; dstY[k++] = srcY[a++]; }
+            while (b < hi) { dstX[k] = srcX[b]; dstY[k++] = srcY[b++]; }
+        }
+        int32_t* swap;
+        swap = srcX; srcX = dstX; dstX = swap;
+        swap = srcY; srcY = dstY; dstY = swap;
+    }
+    if (srcX != x) {
+        memcpy(x, srcX, count * sizeof(int32_t));
+        memcpy(y, srcY, count * sizeof(int32_t));
+    }
+    free(tx);
+    free(ty);
+    return 0;
+}
+
+/*
+ * Build a complete level image from unsorted columns. Returns a malloc'd
+ * buffer (size in *outSize) or NULL if the level is too large or memory
+ * runs out. Used by tools/levelc and by the game's generated test levels.
+ */
+static inline void* levelBuildImage(const int32_t* const xs[LEVEL_ARRAY_COUNT], const int32_t* const ys[LEVEL_ARRAY_COUNT],
+                                    const uint32_t counts[LEVEL_ARRAY_COUNT], uint32_t chunkWidth, uint32_t* outSize) {
+    LevelHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LEVEL_MAGIC, 4);
+    header.version = LEVEL_VERSION;
+    header.endianTag = LEVEL_ENDIAN_TAG;
+    header.chunkWidth = chunkWidth ? chunkWidth : LEVEL_DEFAULT_CHUNK_WIDTH;
+
+    // Chunk span covers every entity's x
+    int64_t minX = 0, maxX = 0;
+    int any = 0;
+    for (int k = 0; k < LEVEL_ARRAY_COUNT; k++) {
+        for (uint32_t i = 0; i < counts[k]; i++) {
+            if (!any || xs[k][i] < minX) minX = xs[k][i];
+            if (!any || xs[k][i] > maxX) maxX = xs[k][i];
+            any = 1;
+        }
+    }
+    int64_t origin = minX >= 0 ? (minX / header.chunkWidth) * header.chunkWidth
+                               : -((-minX + header.chunkWidth - 1) / header.chunkWidth) * (int64_t)header.chunkWidth;
+    uint64_t chunkCount = (uint64_t)((maxX - origin) / header.chunkWidth) + 1;
+    if (origin < INT32_MIN || chunkCount > LEVEL_MAX_CHUNKS) return NULL;
+    header.originX = (int32_t)origin;
+    header.chunkCount = (uint32_t)chunkCount;
+
+    uint64_t offset = levelAlign((uint32_t)sizeof(LevelHeader));
+    header.chunkOffset = (uint32_t)offset;
+    offset = levelAlign((uint32_t)(offset + (chunkCount + 1) * LEVEL_ARRAY_COUNT * sizeof(uint32_t)));
+    for (int k = 0; k < LEVEL_ARRAY_COUNT; k++) {
+        uint64_t bytes = (uint64_t)counts[k] * sizeof(int32_t);
+        if (offset + 2 * bytes + 2 * LEVEL_ALIGNMENT > UINT32_MAX) return NULL;
+        header.arrays[k].count = counts[k];
+        header.arrays[k].xOffset = (uint32_t)offset;
+        offset = levelAlign((uint32_t)(offset + bytes));
+        header.arrays[k].yOffset = (uint32_t)offset;
+        offset = levelAlign((uint32_t)(offset + bytes));
+    }
+    header.fileSize = (uint32_t)offset;
+
+    unsigned char* image = (unsigned char*)calloc(1, header.fileSize);
+    if (!image) return NULL;
+    memcpy(image, &header, sizeof(header));
+    uint32_t* table = (uint32_t*)(image + header.chunkOffset);
+    for (int k = 0; k < LEVEL_ARRAY_COUNT; k++) {
+        int32_t* x = (int32_t*)(image + header.arrays[k].xOffset);
+        int32_t* y = (int32_t*)(image + header.arrays[k].yOffset);
+        if (counts[k]) {
+            memcpy(x, xs[k], counts[k] * sizeof(int32_t));
+            memcpy(y, ys[k], counts[k] * sizeof(int32_t));
+        }
+        if (levelSortByX(x, y, counts[k]) != 0) { free(image); return NULL; }
+        // Chunk start indices: first entity whose chunk is >= c
+        uint32_t i = 0;
+        for (uint32_t c = 0; c <= header.chunkCount; c++) {
+            while (i < counts[k] && levelChunkIndex(&header, x[i]) < c) i++;
+            table[c * LEVEL_ARRAY_COUNT + k] = (c == header.chunkCount) ? counts[k] : i;
+        }
+    }
+    *outSize = header.fileSize;
+    return image;
+}
+
+#endif
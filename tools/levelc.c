@@ -0,0 +1,174 @@
+/*
+ * levelc: converts a text level description (config/<world>.md) into the
+ * binary format in level_format.h.
+ *
+ * Text format, in the same markdown style as config/config.md:
+ *
+ *   # bliss
+ *   ## platforms
+ *   100 500
+ *   ## piwo
+ *   150 450
+ *
+ * Sections are platforms, piwo, ray and gambling_machine; each line under a
+ * section is one "x y" world position. Entities are sorted into streaming
+ * chunks of chunkWidth pixels (default LEVEL_DEFAULT_CHUNK_WIDTH).
+ *
+ * usage: levelc input.md output.lvl [chunkWidth]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../level_format.h"
+
+#define LINE_MAX_LEN 256
+#define MAX_LEVEL_ENTITIES 10000000u
+
+typedef struct {
+    int32_t* x;
+    int32_t* y;
+    uint32_t count;
+    uint32_t capacity;
+} PointList;
+
+static const char* sectionNames[LEVEL_ARRAY_COUNT] = {
+    "platforms",
+    "piwo",
+    "ray",
+    "gambling_machine"
+};
+
+static char* ltrim(char* s) {
+    while (*s && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+    return s;
+}
+
+static void rtrim(char* s) {
+    size_t len = strlen(s);
+    while (len > 0 && (s[len-1] == '\n' || s[len-1] == '\r' || s[len-1] == ' ' || s[len-1] == '\t')) s[--len] = '\0';
+}
+
+static bool appendPoint(PointList* list, int32_t x, int32_t y) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 64;
+        int32_t* nx = realloc(list->x, capacity * sizeof(int32_t));
+        if (!nx) return false;
+        list->x = nx;
+        int32_t* ny = realloc(list->y, capacity * sizeof(int32_t));
+        if (!ny) return false;
+        list->y = ny;
+        list->capacity = capacity;
+    }
+    list->x[list->count] = x;
+    list->y[list->count] = y;
+    list->count++;
+    return true;
+}
+
+static int parseLevel(const char* path, PointList lists[LEVEL_ARRAY_COUNT]) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening level source: %s\n", path);
+        return -1;
+    }
+    char line[LINE_MAX_LEN];
+    int lineNumber = 0;
+    int section = -1;
+    uint32_t total = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char* trimmed = ltrim(line);
+        rtrim(trimmed);
+        if (!*trimmed) continue;
+        if (trimmed[0] == '#') {
+            int hashCount = 0;
+            while (trimmed[hashCount] == '#') hashCount++;
+            if (hashCount != 2) continue;
+            char* name = ltrim(trimmed + hashCount);
+            section = -1;
+            for (int i = 0; i < LEVEL_ARRAY_COUNT; i++) {
+                if (strcmp(name, sectionNames[i]) == 0) section = i;
+            }
+            if (section < 0) fprintf(stderr, "%s:%d: unknown section '%s' ignored\n", path, lineNumber, name);
+            continue;
+        }
+        if (section < 0) continue;
+        long x, y;
+        if (sscanf(trimmed, "%ld %ld", &x, &y) != 2 ||
+            x < INT32_MIN || x > INT32_MAX || y < INT32_MIN || y > INT32_MAX) {
+            fprintf(stderr, "%s:%d: expected \"x y\", got '%s'\n", path, lineNumber, trimmed);
+            fclose(file);
+            return -1;
+        }
+        if (++total > MAX_LEVEL_ENTITIES || !appendPoint(&lists[section], (int32_t)x, (int32_t)y)) {
+            fprintf(stderr, "%s:%d: too many entities\n", path, lineNumber);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int writeLevel(const char* path, PointList lists[LEVEL_ARRAY_COUNT], uint32_t chunkWidth) {
+    const int32_t* xs[LEVEL_ARRAY_COUNT];
+    const int32_t* ys[LEVEL_ARRAY_COUNT];
+    uint32_t counts[LEVEL_ARRAY_COUNT];
+    for (int i = 0; i < LEVEL_ARRAY_COUNT; i++) {
+        xs[i] = lists[i].x;
+        ys[i] = lists[i].y;
+        counts[i] = lists[i].count;
+    }
+    uint32_t size = 0;
+    unsigned char* image = levelBuildImage(xs, ys, counts, chunkWidth, &size);
+    if (!image) {
+        fprintf(stderr, "Level too large or out of memory building %s\n", path);
+        return -1;
+    }
+    const LevelHeader* header = (const LevelHeader*)image;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening output file: %s\n", path);
+        free(image);
+        return -1;
+    }
+    size_t written = fwrite(image, 1, size, file);
+    int closed = fclose(file);
+    if (written != size || closed != 0) {
+        fprintf(stderr, "Error writing %s\n", path);
+        free(image);
+        return -1;
+    }
+    printf("%s: %u platforms, %u piwo, %u ray, %u gambling machines in %u chunks (%u bytes)\n", path,
+           counts[LEVEL_PLATFORMS], counts[LEVEL_PIWO], counts[LEVEL_RAYS], counts[LEVEL_MACHINES],
+           header->chunkCount, size);
+    free(image);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s input.md output.lvl [chunkWidth]\n", argv[0]);
+        return 1;
+    }
+    uint32_t chunkWidth = LEVEL_DEFAULT_CHUNK_WIDTH;
+    if (argc == 4) {
+        long width = strtol(argv[3], NULL, 10);
+        if (width < 64 || width > 1 << 20) {
+            fprintf(stderr, "chunkWidth must be between 64 and %d\n", 1 << 20);
+            return 1;
+        }
+        chunkWidth = (uint32_t)width;
+    }
+    PointList lists[LEVEL_ARRAY_COUNT];
+    memset(lists, 0, sizeof(lists));
+    int result = parseLevel(argv[1], lists);
+    if (result == 0) result = writeLevel(argv[2], lists, chunkWidth);
+    for (int i = 0; i < LEVEL_ARRAY_COUNT; i++) {
+        free(lists[i].x);
+        free(lists[i].y);
+    }
+    return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/*
+ * packc: bundles asset files into one archive in the format of asset_pack.h.
+ *
+ * Each input is stored under the path given on the command line, so run it
+ * from the repository root with the same relative paths the game loads
+ * (images/gun.bmp, COMIC.TTF, config/config.md, ...).
+ *
+ * usage: packc output.pak file...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../asset_pack.h"
+
+typedef struct {
+    const char* path;
+    unsigned char* data;
+    uint32_t size;
+} PackInput;
+
+static int readInput(PackInput* input) {
+    FILE* file = fopen(input->path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error opening asset: %s\n", input->path);
+        return -1;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    if (size < 0 || size > (long)UINT32_MAX || fseek(file, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Error sizing asset: %s\n", input->path);
+        fclose(file);
+        return -1;
+    }
+    input->size = (uint32_t)size;
+    input->data = malloc(size ? (size_t)size : 1);
+    if (!input->data || fread(input->data, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, "Error reading asset: %s\n", input->path);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+static int compareInputs(const void* a, const void* b) {
+    return strcmp(((const PackInput*)a)->path, ((const PackInput*)b)->path);
+}
+
+static int writePack(const char* path, PackInput* inputs, uint32_t count) {
+    AssetPackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ASSET_PACK_MAGIC, 4);
+    header.version = ASSET_PACK_VERSION;
+    header.endianTag = ASSET_PACK_ENDIAN_TAG;
+    header.entryCount = count;
+    header.indexOffset = assetPackAlign((uint32_t)sizeof(AssetPackHeader));
+
+    AssetPackEntry* index = calloc(count ? count : 1, sizeof(AssetPackEntry));
+    if (!index) return -1;
+    uint64_t offset = assetPackAlign((uint32_t)(header.indexOffset + (uint64_t)count * sizeof(AssetPackEntry)));
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(index[i].path, ASSET_PACK_PATH_MAX, "%s", inputs[i].path);
+        index[i].offset = (uint32_t)offset;
+        index[i].size = inputs[i].size;
+        offset += inputs[i].size;
+        if (offset + ASSET_PACK_ALIGNMENT > UINT32_MAX) {
+            fprintf(stderr, "Pack too large at %s\n", inputs[i].path);
+            free(index);
+            return -1;
+        }
+        offset = assetPackAlign((uint32_t)offset);
+    }
+    header.fileSize = (uint32_t)offset;
+
+    unsigned char* image = calloc(1, header.fileSize);
+    if (!image) {
+        free(index);
+        return -1;
+    }
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + header.indexOffset, index, count * sizeof(AssetPackEntry));
+    for (uint32_t i = 0; i < count; i++) {
+        if (inputs[i].size) memcpy(image + index[i].offset, inputs[i].data, inputs[i].size);
+    }
+    free(index);
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening output file: %s\n", path);
+        free(image);
+        return -1;
+    }
+    size_t written = fwrite(image, 1, header.fileSize, file);
+    int closed = fclose(file);
+    free(image);
+    if (written != header.fileSize || closed != 0) {
+        fprintf(stderr, "Error writing %s\n", path);
+        return -1;
+    }
+    printf("%s: %u assets (%u bytes)\n", path, count, header.fileSize);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s output.pak file...\n", argv[0]);
+        return 1;
+    }
+    uint32_t count = (uint32_t)(argc - 2);
+    PackInput* inputs = calloc(count, sizeof(PackInput));
+    if (!inputs) return 1;
+    int result = 0;
+    for (uint32_t i = 0; i < count && result == 0; i++) {
+        inputs[i].path = argv[i + 2];
+        if (strlen(inputs[i].path) >= ASSET_PACK_PATH_MAX) {
+            fprintf(stderr, "Asset path too long: %s\n", inputs[i].path);
+            result = -1;
+        } else {
+            result = readInput(&inputs[i]);
+        }
+    }
+    if (result == 0) {
+        qsort(inputs, count, sizeof(PackInput), compareInputs);
+        for (uint32_t i = 1; i < count && result == 0; i++) {
+            if (strcmp(inputs[i - 1].path, inputs[i].path) == 0) {
+                fprintf(stderr, "Duplicate asset: %s\n", inputs[i].path);
+                result = -1;
+            }
+        }
+    }
+    if (result == 0) result = writePack(argv[1], inputs, count);
+    for (uint32_t i = 0; i < count; i++) free(inputs[i].data);
+    free(inputs);
+    return result == 0 ? 0 : 1;
+}